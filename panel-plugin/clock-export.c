@@ -0,0 +1,392 @@
+/*
+ *  Batch exporter for analog clock faces
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cairo.h>
+#ifdef CAIRO_HAS_SVG_SURFACE
+#include <cairo-svg.h>
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock-face.h"
+
+typedef struct export_t {
+  /* Read-only once the workers run */
+  GArray *times;     /* guint, minutes since midnight */
+  GPtrArray *zones;  /* GTimeZone, empty to draw the times as given */
+  gchar **zoneNames;
+  GArray *sizes;     /* gint, pixels */
+  gint year, month, day; /* UTC day the times belong to */
+  gboolean svg;
+  gdouble rgb[3];
+  clock_face_style_t style;
+  const gchar *theme; /* NULL for the built-in face */
+  const gchar *outdir;
+  gint njobs;
+  /* Shared between the workers */
+  gint next;   /* Next job to take, atomic */
+  gint failed; /* Frames that could not be written, atomic */
+} export_t;
+
+static gboolean ParseTime(const gchar *str, guint *minutes) {
+  guint hr, min;
+  gchar c;
+
+  if (sscanf(str, "%u:%u%c", &hr, &min, &c) != 2 || hr > 23 || min > 59)
+    return FALSE;
+  *minutes = hr * 60 + min;
+  return TRUE;
+}
+
+static gboolean ParseColor(const gchar *str, gdouble rgb[3]) {
+  guint r, g, b;
+  gchar c;
+
+  if (sscanf(str, "#%02x%02x%02x%c", &r, &g, &b, &c) != 3)
+    return FALSE;
+  rgb[0] = r / 255.0;
+  rgb[1] = g / 255.0;
+  rgb[2] = b / 255.0;
+  return TRUE;
+}
+
+static gboolean RenderFrame(export_t *ex, clock_face_t *face,
+                            cairo_surface_t *image, gint size, guint hr,
+                            guint min, const gchar *path) {
+  cairo_surface_t *surface = image;
+  cairo_status_t status;
+  cairo_t *cr;
+
+#ifdef CAIRO_HAS_SVG_SURFACE
+  if (ex->svg)
+    surface = cairo_svg_surface_create(path, size, size);
+#endif
+
+  cr = cairo_create(surface);
+  if (image) {
+    /* The worker's surface is reused frame after frame */
+    cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  }
+  cairo_set_source_rgb(cr, ex->rgb[0], ex->rgb[1], ex->rgb[2]);
+  clock_face_set_time(face, hr, min);
+  clock_face_render(face, cr);
+  cairo_destroy(cr);
+
+  if (image) {
+    status = cairo_surface_write_to_png(image, path);
+  } else {
+    cairo_surface_finish(surface);
+    status = cairo_surface_status(surface);
+    cairo_surface_destroy(surface);
+  }
+
+  return status == CAIRO_STATUS_SUCCESS;
+}
+
+static gpointer ExportWorker(gpointer data)
+/* Takes jobs until there are none left.  Every worker owns one face (and
+   so one cached dial) and one image surface per size */
+{
+  export_t *ex = (export_t *)data;
+  guint nsizes = ex->sizes->len;
+  guint nzones = MAX(ex->zones->len, 1);
+  clock_face_t **faces = g_new0(clock_face_t *, nsizes);
+  cairo_surface_t **images = g_new0(cairo_surface_t *, nsizes);
+  GTimeZone *utc = g_time_zone_new_utc();
+  GDateTime *at, *local;
+  guint s, z, t, hr, min;
+  gchar *name, *path;
+  gint job, size;
+
+  while ((job = g_atomic_int_add(&ex->next, 1)) < ex->njobs) {
+    s = job % nsizes;
+    z = (job / nsizes) % nzones;
+    t = job / nsizes / nzones;
+    size = g_array_index(ex->sizes, gint, s);
+    hr = g_array_index(ex->times, guint, t) / 60;
+    min = g_array_index(ex->times, guint, t) % 60;
+
+    if (faces[s] == NULL) {
+      faces[s] = clock_face_new(size, 1.0, ex->style);
+      /* Already validated by main() */
+      clock_face_set_theme(faces[s], ex->theme, NULL);
+      if (!ex->svg)
+        images[s] =
+            cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    }
+
+    if (ex->zones->len) {
+      /* The time is a UTC instant, show it as each zone's clock would */
+      at = g_date_time_new(utc, ex->year, ex->month, ex->day, hr, min, 0);
+      local = g_date_time_to_timezone(at, g_ptr_array_index(ex->zones, z));
+      hr = g_date_time_get_hour(local);
+      min = g_date_time_get_minute(local);
+      g_date_time_unref(local);
+      g_date_time_unref(at);
+
+      name = g_strdelimit(g_strdup(ex->zoneNames[z]), "/", '_');
+      path = g_strdup_printf("%s/%s-%dpx-%02u%02u.%s", ex->outdir, name, size,
+                             g_array_index(ex->times, guint, t) / 60,
+                             g_array_index(ex->times, guint, t) % 60,
+                             ex->svg ? "svg" : "png");
+      g_free(name);
+    } else {
+      path = g_strdup_printf("%s/%dpx-%02u%02u.%s", ex->outdir, size, hr, min,
+                             ex->svg ? "svg" : "png");
+    }
+
+    if (!RenderFrame(ex, faces[s], images[s], size, hr, min, path)) {
+      g_printerr("Could not write %s\n", path);
+      g_atomic_int_inc(&ex->failed);
+    }
+    g_free(path);
+  }
+
+  for (s = 0; s < nsizes; s++) {
+    clock_face_free(faces[s]);
+    if (images[s])
+      cairo_surface_destroy(images[s]);
+  }
+  g_free(faces);
+  g_free(images);
+  g_time_zone_unref(utc);
+
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  gchar **optTimes = NULL, **optZones = NULL, **optSizes = NULL;
+  gchar *optFrom = NULL, *optTo = NULL, *optDate = NULL;
+  gchar *optFormat = NULL, *optColor = NULL, *optStyle = NULL;
+  gchar *optOutdir = NULL, *optTheme = NULL;
+  gint optStep = 1, optThreads = 0;
+  GOptionEntry entries[] = {
+      {"time", 't', 0, G_OPTION_ARG_STRING_ARRAY, &optTimes,
+       "Render this time (repeatable)", "HH:MM"},
+      {"from", 0, 0, G_OPTION_ARG_STRING, &optFrom,
+       "First time of a range (default 00:00)", "HH:MM"},
+      {"to", 0, 0, G_OPTION_ARG_STRING, &optTo,
+       "Last time of a range (default 23:59)", "HH:MM"},
+      {"step", 0, 0, G_OPTION_ARG_INT, &optStep,
+       "Minutes between range frames (default 1)", "N"},
+      {"timezone", 'z', 0, G_OPTION_ARG_STRING_ARRAY, &optZones,
+       "Treat times as UTC and render them for this zone (repeatable)", "TZ"},
+      {"date", 'd', 0, G_OPTION_ARG_STRING, &optDate,
+       "UTC day the times belong to (default today)", "YYYY-MM-DD"},
+      {"size", 's', 0, G_OPTION_ARG_STRING_ARRAY, &optSizes,
+       "Face size in pixels (repeatable, default 64)", "N"},
+      {"format", 'f', 0, G_OPTION_ARG_STRING, &optFormat,
+       "png (default) or svg", "FORMAT"},
+      {"style", 0, 0, G_OPTION_ARG_STRING, &optStyle,
+       "filled (default) or line pointers", "STYLE"},
+      {"theme", 0, 0, G_OPTION_ARG_FILENAME, &optTheme,
+       "Clock face theme directory", "DIR"},
+      {"color", 'c', 0, G_OPTION_ARG_STRING, &optColor,
+       "Face color (default #000000)", "#RRGGBB"},
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &optOutdir,
+       "Output directory (default .)", "DIR"},
+      {"threads", 'j', 0, G_OPTION_ARG_INT, &optThreads,
+       "Worker threads (default: one per core)", "N"},
+      {NULL}};
+  GOptionContext *context;
+  GError *error = NULL;
+  GThread **workers;
+  clock_face_t *probe;
+  GDateTime *today;
+  GTimeZone *tz;
+  export_t ex;
+  guint first = 0, last = 24 * 60 - 1, minutes;
+  gint i, size, status = EXIT_SUCCESS;
+
+  context = g_option_context_new("- render analog clock faces to files");
+  g_option_context_set_summary(
+      context, "Renders one file per time, timezone and size, e.g.\n"
+               "  appletclock-export -s 64 -s 128 -o frames\n"
+               "writes all 1440 minutes of the day at two sizes.");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  memset(&ex, 0, sizeof(ex));
+  ex.times = g_array_new(FALSE, FALSE, sizeof(guint));
+  ex.sizes = g_array_new(FALSE, FALSE, sizeof(gint));
+  ex.zones = g_ptr_array_new_with_free_func((GDestroyNotify)g_time_zone_unref);
+  ex.zoneNames = optZones;
+  ex.outdir = optOutdir ? optOutdir : ".";
+  ex.style = CLOCK_FACE_STYLE_FILLED;
+
+  /* Times: an explicit list, otherwise a range */
+  for (i = 0; optTimes && optTimes[i]; i++) {
+    if (!ParseTime(optTimes[i], &minutes)) {
+      g_printerr("Invalid time '%s'\n", optTimes[i]);
+      status = EXIT_FAILURE;
+      goto out;
+    }
+    g_array_append_val(ex.times, minutes);
+  }
+  if (ex.times->len == 0) {
+    if ((optFrom && !ParseTime(optFrom, &first)) ||
+        (optTo && !ParseTime(optTo, &last)) || optStep < 1) {
+      g_printerr("Invalid time range\n");
+      status = EXIT_FAILURE;
+      goto out;
+    }
+    for (minutes = first; minutes <= last; minutes += optStep)
+      g_array_append_val(ex.times, minutes);
+  }
+
+  for (i = 0; optSizes && optSizes[i]; i++) {
+    size = atoi(optSizes[i]);
+    if (size < 1 || size > 8192) {
+      g_printerr("Invalid size '%s'\n", optSizes[i]);
+      status = EXIT_FAILURE;
+      goto out;
+    }
+    g_array_append_val(ex.sizes, size);
+  }
+  if (ex.sizes->len == 0) {
+    size = 64;
+    g_array_append_val(ex.sizes, size);
+  }
+
+  /* Zones are loaded once here and shared read-only by the workers */
+  for (i = 0; optZones && optZones[i]; i++) {
+#if GLIB_CHECK_VERSION(2, 68, 0)
+    tz = g_time_zone_new_identifier(optZones[i]);
+    if (tz == NULL) {
+      g_printerr("Unknown timezone '%s'\n", optZones[i]);
+      status = EXIT_FAILURE;
+      goto out;
+    }
+#else
+    /* Older GLib cannot tell, unknown names come back as UTC */
+    tz = g_time_zone_new(optZones[i]);
+#endif
+    g_ptr_array_add(ex.zones, tz);
+  }
+
+  if (optDate) {
+    if (sscanf(optDate, "%d-%d-%d", &ex.year, &ex.month, &ex.day) != 3 ||
+        !g_date_valid_dmy(ex.day, ex.month, ex.year)) {
+      g_printerr("Invalid date '%s'\n", optDate);
+      status = EXIT_FAILURE;
+      goto out;
+    }
+  } else {
+    today = g_date_time_new_now_utc();
+    g_date_time_get_ymd(today, &ex.year, &ex.month, &ex.day);
+    g_date_time_unref(today);
+  }
+
+  if (optFormat && strcmp(optFormat, "svg") == 0) {
+#ifdef CAIRO_HAS_SVG_SURFACE
+    ex.svg = TRUE;
+#else
+    g_printerr("This cairo has no SVG support\n");
+    status = EXIT_FAILURE;
+    goto out;
+#endif
+  } else if (optFormat && strcmp(optFormat, "png") != 0) {
+    g_printerr("Unknown format '%s'\n", optFormat);
+    status = EXIT_FAILURE;
+    goto out;
+  }
+
+  if (optStyle && strcmp(optStyle, "line") == 0) {
+    ex.style = CLOCK_FACE_STYLE_LINE;
+  } else if (optStyle && strcmp(optStyle, "filled") != 0) {
+    g_printerr("Unknown style '%s'\n", optStyle);
+    status = EXIT_FAILURE;
+    goto out;
+  }
+
+  if (optColor && !ParseColor(optColor, ex.rgb)) {
+    g_printerr("Invalid color '%s'\n", optColor);
+    status = EXIT_FAILURE;
+    goto out;
+  }
+
+  if (optTheme) {
+    /* Fail early rather than once per worker */
+    probe = clock_face_new(0, 1.0, ex.style);
+    if (!clock_face_set_theme(probe, optTheme, &error)) {
+      g_printerr("Could not load theme %s: %s\n", optTheme, error->message);
+      g_error_free(error);
+      clock_face_free(probe);
+      status = EXIT_FAILURE;
+      goto out;
+    }
+    clock_face_free(probe);
+    ex.theme = optTheme;
+  }
+
+  if (g_mkdir_with_parents(ex.outdir, 0755) != 0) {
+    g_printerr("Could not create %s\n", ex.outdir);
+    status = EXIT_FAILURE;
+    goto out;
+  }
+
+  ex.njobs = ex.times->len * MAX(ex.zones->len, 1) * ex.sizes->len;
+  if (optThreads < 1)
+    optThreads = g_get_num_processors();
+  optThreads = MIN(optThreads, ex.njobs);
+
+  workers = g_new0(GThread *, optThreads);
+  for (i = 0; i < optThreads; i++)
+    workers[i] = g_thread_new("export", ExportWorker, &ex);
+  for (i = 0; i < optThreads; i++)
+    g_thread_join(workers[i]);
+  g_free(workers);
+
+  if (ex.failed)
+    status = EXIT_FAILURE;
+
+out:
+  g_array_free(ex.times, TRUE);
+  g_array_free(ex.sizes, TRUE);
+  g_ptr_array_unref(ex.zones);
+  g_strfreev(optTimes);
+  g_strfreev(optZones);
+  g_strfreev(optSizes);
+  g_free(optFrom);
+  g_free(optTo);
+  g_free(optDate);
+  g_free(optFormat);
+  g_free(optStyle);
+  g_free(optColor);
+  g_free(optOutdir);
+  g_free(optTheme);
+
+  return status;
+}
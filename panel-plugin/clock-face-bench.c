@@ -0,0 +1,164 @@
+/*
+ *  Memory benchmark for many analog clock faces in one process
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <cairo.h>
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "clock-face.h"
+
+typedef struct bench_t {
+  gint faces;
+  gint size;
+  gdouble scale;
+  gboolean mixed; /* Every face one pixel larger than the last */
+  const gchar *theme;
+} bench_t;
+
+static gint64 Rss(void)
+/* Resident set size in bytes, -1 where /proc is not available */
+{
+  gchar *statm;
+  long pages, resident;
+  gint64 rss = -1;
+
+  if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL)) {
+    if (sscanf(statm, "%ld %ld", &pages, &resident) == 2)
+      rss = (gint64)resident * sysconf(_SC_PAGESIZE);
+    g_free(statm);
+  }
+
+  return rss;
+}
+
+static gboolean Pass(const bench_t *b, gboolean shared)
+/* Creates and draws b->faces faces, as the panel would for that many
+   clocks, and reports what they hold.  FALSE if freeing them leaks. */
+{
+  clock_face_t **faces = g_new0(clock_face_t *, b->faces);
+  clock_face_stats_t before, after, freed;
+  cairo_surface_t *target;
+  cairo_t *cr;
+  gint64 rss0, rss1;
+  gint i, largest;
+
+  largest = b->mixed ? b->size + b->faces : b->size;
+  target = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, largest, largest);
+
+  clock_face_get_stats(&before);
+  rss0 = Rss();
+
+  for (i = 0; i < b->faces; i++) {
+    faces[i] = clock_face_new(b->mixed ? b->size + i : b->size, b->scale,
+                              CLOCK_FACE_STYLE_FILLED);
+    clock_face_set_shared(faces[i], shared);
+    if (b->theme)
+      clock_face_set_theme(faces[i], b->theme, NULL);
+    clock_face_set_time(faces[i], 10, 10);
+
+    cr = cairo_create(target);
+    clock_face_render(faces[i], cr);
+    cairo_destroy(cr);
+  }
+
+  clock_face_get_stats(&after);
+  rss1 = Rss();
+
+  for (i = 0; i < b->faces; i++)
+    clock_face_free(faces[i]);
+  g_free(faces);
+  cairo_surface_destroy(target);
+  clock_face_get_stats(&freed);
+
+  printf("%-8s %4d faces %10" G_GSIZE_FORMAT " raster bytes %8" G_GSIZE_FORMAT
+         " per face",
+         shared ? "shared" : "private", b->faces, after.bytes - before.bytes,
+         (after.bytes - before.bytes) / b->faces);
+  if (rss0 >= 0 && rss1 >= 0)
+    printf(", RSS %+" G_GINT64_FORMAT " bytes per face",
+           (rss1 - rss0) / b->faces);
+  printf("\n");
+
+  return freed.bytes == before.bytes;
+}
+
+int main(int argc, char **argv) {
+  bench_t b = {8, 48, 1.0, FALSE, NULL};
+  gchar *optTheme = NULL;
+  GOptionEntry entries[] = {
+      {"faces", 'n', 0, G_OPTION_ARG_INT, &b.faces,
+       "Faces, i.e. clocks in the process (default 8)", "N"},
+      {"size", 's', 0, G_OPTION_ARG_INT, &b.size,
+       "Face size in pixels (default 48)", "N"},
+      {"scale", 0, 0, G_OPTION_ARG_DOUBLE, &b.scale,
+       "Device scale factor (default 1)", "F"},
+      {"mixed", 'm', 0, G_OPTION_ARG_NONE, &b.mixed,
+       "Give every face a different size", NULL},
+      {"theme", 0, 0, G_OPTION_ARG_FILENAME, &optTheme,
+       "Clock face theme directory", "DIR"},
+      {NULL}};
+  GOptionContext *context;
+  GError *error = NULL;
+  clock_face_t *probe;
+  gboolean ok;
+
+  context = g_option_context_new("- measure the memory of many clock faces");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free(context);
+
+  if (b.faces < 1 || b.size < 1 || b.scale <= 0) {
+    g_printerr("Faces, size and scale must be positive\n");
+    return EXIT_FAILURE;
+  }
+
+  if (optTheme) {
+    probe = clock_face_new(0, 1.0, CLOCK_FACE_STYLE_FILLED);
+    if (!clock_face_set_theme(probe, optTheme, &error)) {
+      g_printerr("Could not load theme %s: %s\n", optTheme, error->message);
+      g_error_free(error);
+      clock_face_free(probe);
+      g_free(optTheme);
+      return EXIT_FAILURE;
+    }
+    clock_face_free(probe);
+    b.theme = optTheme;
+  }
+
+  ok = Pass(&b, FALSE);
+  ok = Pass(&b, TRUE) && ok;
+  if (!ok)
+    g_printerr("Rasters were left behind after freeing the faces\n");
+
+  g_free(optTheme);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
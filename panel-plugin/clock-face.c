@@ -0,0 +1,656 @@
+/*
+ *  Headless analog clock face for the Xfce4 panel clock
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#ifdef HAVE_RSVG
+#include <librsvg/rsvg.h>
+#endif
+
+#include "clock-face.h"
+
+#define CLOCK_SCALE 0.1
+#define TICKS_TO_RADIANS(x) (G_PI - (G_PI / 30.0) * (x))
+
+#define THEME_FILE "face.theme"
+
+/* Length of each pointer relative to the radius */
+static const gdouble hand_scale[] = {0.8, 0.5};
+
+struct clock_face_t {
+  gint width;
+  gint height;
+  gdouble scale; /* Device scale factor */
+  clock_face_style_t style;
+  gdouble ticks[2]; /* Indexed by clock_face_hand_t */
+  cairo_surface_t *dial; /* Dial raster, NULL until needed: an A8 mask for
+                            the built-in face, ARGB for a theme */
+  gchar *dialKey; /* Set when dial comes from the shared cache */
+  gboolean shared; /* Take the built-in dial from the shared cache */
+#ifdef HAVE_RSVG
+  struct theme_t *theme; /* NULL for the built-in face */
+#endif
+};
+
+/* Unit vectors of the 12 hour marks, see MarksInit() */
+static gdouble mark_sin[12];
+static gdouble mark_cos[12];
+
+/* Built-in dials are the same for every face of a given size and scale, so
+   faces that opt in (clock_face_set_shared()) use one mask each, keyed
+   "WxH@scale".  Faces hold a reference; the last one to let go drops the
+   entry.  The lock only guards the table: a cairo surface must not be used
+   as a source from several threads at once, so sharing faces have to stay
+   on one thread. */
+G_LOCK_DEFINE_STATIC(dials);
+static GHashTable *dials = NULL;
+
+/* Pixel memory of every live raster, see RasterNew() */
+G_LOCK_DEFINE_STATIC(stats);
+static gsize raster_bytes = 0;
+static cairo_user_data_key_t raster_key;
+
+/* Renders that found their dial or hand raster ready, and that had to
+   rasterize it first; atomic, may wrap */
+static gint raster_hits = 0;
+static gint raster_misses = 0;
+
+#ifdef HAVE_RSVG
+typedef struct theme_hand_t {
+  RsvgHandle *svg;  /* Drawn pointing at 12 */
+  gdouble pivotX;   /* Rotation pivot, theme units */
+  gdouble pivotY;
+  gdouble reach;    /* Farthest point from the pivot, theme units */
+  cairo_surface_t *sprite; /* Rasterized at the current size and scale */
+} theme_hand_t;
+
+typedef struct theme_t {
+  RsvgHandle *dial;
+  gdouble units; /* Dial extent, theme units */
+  theme_hand_t hands[2]; /* Indexed by clock_face_hand_t */
+} theme_t;
+#endif
+
+static void Geometry(const clock_face_t *face, gdouble *xc, gdouble *yc,
+                     gdouble *radius) {
+  *xc = face->width / 2;
+  *yc = face->height / 2;
+  *radius = ((*xc < *yc) ? *xc : *yc);
+}
+
+static void MarksInit(void) {
+  static gsize done = 0;
+  gint i;
+
+  if (g_once_init_enter(&done)) {
+    for (i = 0; i < 12; i++) {
+      mark_sin[i] = sin(TICKS_TO_RADIANS(i * 5));
+      mark_cos[i] = cos(TICKS_TO_RADIANS(i * 5));
+    }
+    g_once_init_leave(&done, 1);
+  }
+}
+
+static void DrawTicks(cairo_t *cr, gdouble xc, gdouble yc, gdouble radius) {
+  gint i;
+  gdouble x, y;
+
+  for (i = 0; i < 12; i++) {
+    /* calculate */
+    x = xc + mark_sin[i] * (radius * (1.0 - CLOCK_SCALE));
+    y = yc + mark_cos[i] * (radius * (1.0 - CLOCK_SCALE));
+
+    /* draw arc */
+    cairo_move_to(cr, x, y);
+    cairo_arc(cr, x, y, radius * CLOCK_SCALE, 0, 2 * G_PI);
+    cairo_close_path(cr);
+  }
+
+  /* fill the arcs */
+  cairo_fill(cr);
+}
+
+static void DrawPointer(cairo_t *cr, gdouble xc, gdouble yc, gdouble radius,
+                        gdouble angle, gdouble scale, gboolean line) {
+  gdouble xs, ys;
+  gdouble xt, yt;
+
+  /* calculate tip position */
+  xt = xc + sin(angle) * radius * scale;
+  yt = yc + cos(angle) * radius * scale;
+
+  if (line) {
+    /* draw the line */
+    cairo_move_to(cr, xc, yc);
+    cairo_line_to(cr, xt, yt);
+
+    /* draw the line */
+    cairo_stroke(cr);
+  } else {
+    /* calculate start position */
+    xs = xc + sin(angle - 0.5 * G_PI) * radius * CLOCK_SCALE;
+    ys = yc + cos(angle - 0.5 * G_PI) * radius * CLOCK_SCALE;
+
+    /* draw the pointer */
+    cairo_move_to(cr, xs, ys);
+    cairo_arc(cr, xc, yc, radius * CLOCK_SCALE, -angle + G_PI, -angle);
+    cairo_line_to(cr, xt, yt);
+    cairo_close_path(cr);
+
+    /* fill the pointer */
+    cairo_fill(cr);
+  }
+}
+
+static void RasterFreed(void *data) {
+  G_LOCK(stats);
+  raster_bytes -= GPOINTER_TO_SIZE(data);
+  G_UNLOCK(stats);
+}
+
+static void RasterLookup(gboolean hit) {
+  g_atomic_int_inc(hit ? &raster_hits : &raster_misses);
+}
+
+static cairo_surface_t *RasterNew(cairo_format_t format, gdouble width,
+                                  gdouble height, gdouble scale)
+/* An image surface of width x height user units at the device scale,
+   accounted in raster_bytes until cairo frees it */
+{
+  cairo_surface_t *surface;
+  gsize bytes;
+
+  surface = cairo_image_surface_create(format, ceil(width * scale),
+                                       ceil(height * scale));
+  cairo_surface_set_device_scale(surface, scale, scale);
+
+  bytes = (gsize)cairo_image_surface_get_stride(surface) *
+          cairo_image_surface_get_height(surface);
+  G_LOCK(stats);
+  raster_bytes += bytes;
+  G_UNLOCK(stats);
+  cairo_surface_set_user_data(surface, &raster_key, GSIZE_TO_POINTER(bytes),
+                              RasterFreed);
+
+  return surface;
+}
+
+static cairo_surface_t *DialRasterize(const clock_face_t *face) {
+  cairo_surface_t *dial;
+  gdouble xc, yc, radius;
+  cairo_t *cr;
+
+  dial = RasterNew(CAIRO_FORMAT_A8, face->width, face->height, face->scale);
+
+  Geometry(face, &xc, &yc, &radius);
+  cr = cairo_create(dial);
+  DrawTicks(cr, xc, yc, radius);
+  cairo_destroy(cr);
+
+  return dial;
+}
+
+static void DialAcquire(clock_face_t *face) {
+  cairo_surface_t *dial;
+  gchar *key;
+
+  key = g_strdup_printf("%dx%d@%g", face->width, face->height, face->scale);
+
+  G_LOCK(dials);
+  if (G_UNLIKELY(dials == NULL))
+    dials = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)cairo_surface_destroy);
+  dial = g_hash_table_lookup(dials, key);
+  RasterLookup(dial != NULL);
+  if (dial == NULL) {
+    dial = DialRasterize(face);
+    g_hash_table_insert(dials, g_strdup(key), dial);
+  }
+  face->dial = cairo_surface_reference(dial);
+  face->dialKey = key;
+  G_UNLOCK(dials);
+}
+
+static void DialRelease(clock_face_t *face) {
+  G_LOCK(dials);
+  /* Only the table and this face left */
+  if (cairo_surface_get_reference_count(face->dial) == 2)
+    g_hash_table_remove(dials, face->dialKey);
+  cairo_surface_destroy(face->dial);
+  G_UNLOCK(dials);
+
+  face->dial = NULL;
+  g_free(face->dialKey);
+  face->dialKey = NULL;
+}
+
+static void DropCaches(clock_face_t *face) {
+#ifdef HAVE_RSVG
+  gint i;
+
+  if (face->theme) {
+    for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++) {
+      if (face->theme->hands[i].sprite) {
+        cairo_surface_destroy(face->theme->hands[i].sprite);
+        face->theme->hands[i].sprite = NULL;
+      }
+    }
+  }
+#endif
+  if (face->dialKey) {
+    DialRelease(face);
+  } else if (face->dial) {
+    cairo_surface_destroy(face->dial);
+    face->dial = NULL;
+  }
+}
+
+#ifdef HAVE_RSVG
+static void ThemeFree(theme_t *theme) {
+  gint i;
+
+  if (theme == NULL)
+    return;
+  for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++) {
+    if (theme->hands[i].sprite)
+      cairo_surface_destroy(theme->hands[i].sprite);
+    if (theme->hands[i].svg)
+      g_object_unref(theme->hands[i].svg);
+  }
+  if (theme->dial)
+    g_object_unref(theme->dial);
+  g_free(theme);
+}
+
+static void SvgSize(RsvgHandle *svg, gdouble *width, gdouble *height)
+/* Natural size in theme units (CSS pixels) */
+{
+#if LIBRSVG_CHECK_VERSION(2, 52, 0)
+  gboolean hasWidth, hasHeight, hasViewBox;
+  RsvgLength w, h;
+  RsvgRectangle viewBox;
+
+  if (rsvg_handle_get_intrinsic_size_in_pixels(svg, width, height))
+    return;
+  /* Only percentages or no size at all: fall back to the viewBox */
+  rsvg_handle_get_intrinsic_dimensions(svg, &hasWidth, &w, &hasHeight, &h,
+                                       &hasViewBox, &viewBox);
+  *width = hasViewBox ? viewBox.width : 0;
+  *height = hasViewBox ? viewBox.height : 0;
+#else
+  RsvgDimensionData dim;
+
+  rsvg_handle_get_dimensions(svg, &dim);
+  *width = dim.width;
+  *height = dim.height;
+#endif
+}
+
+static void SvgRender(RsvgHandle *svg, cairo_t *cr)
+/* Draws the document at its natural size at the origin of cr */
+{
+#if LIBRSVG_CHECK_VERSION(2, 52, 0)
+  RsvgRectangle viewport = {0, 0, 0, 0};
+
+  SvgSize(svg, &viewport.width, &viewport.height);
+  rsvg_handle_render_document(svg, cr, &viewport, NULL);
+#else
+  rsvg_handle_render_cairo(svg, cr);
+#endif
+}
+
+static RsvgHandle *ThemeLoadSvg(GKeyFile *kf, const gchar *dir,
+                                const gchar *group, GError **error) {
+  RsvgHandle *svg;
+  gchar *file, *path;
+
+  if (!(file = g_key_file_get_string(kf, group, "File", error)))
+    return NULL;
+  path = g_build_filename(dir, file, NULL);
+  svg = rsvg_handle_new_from_file(path, error);
+  g_free(path);
+  g_free(file);
+
+  return svg;
+}
+
+static gboolean ThemeLoadHand(GKeyFile *kf, const gchar *dir,
+                              const gchar *group, theme_hand_t *hand,
+                              GError **error) {
+  gdouble width, height, dx, dy;
+
+  if (!(hand->svg = ThemeLoadSvg(kf, dir, group, error)))
+    return FALSE;
+
+  /* Default pivot: bottom centre of the hand */
+  SvgSize(hand->svg, &width, &height);
+  hand->pivotX = width / 2.0;
+  hand->pivotY = height;
+  if (g_key_file_has_key(kf, group, "PivotX", NULL))
+    hand->pivotX = g_key_file_get_double(kf, group, "PivotX", NULL);
+  if (g_key_file_has_key(kf, group, "PivotY", NULL))
+    hand->pivotY = g_key_file_get_double(kf, group, "PivotY", NULL);
+
+  dx = MAX(hand->pivotX, width - hand->pivotX);
+  dy = MAX(hand->pivotY, height - hand->pivotY);
+  hand->reach = sqrt(dx * dx + dy * dy);
+
+  return TRUE;
+}
+
+static theme_t *ThemeLoad(const gchar *dir, GError **error) {
+  theme_t *theme = g_new0(theme_t, 1);
+  gdouble width, height;
+  GKeyFile *kf = g_key_file_new();
+  gchar *path = g_build_filename(dir, THEME_FILE, NULL);
+  gboolean ok;
+
+  ok = g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, error) &&
+       (theme->dial = ThemeLoadSvg(kf, dir, "Dial", error)) != NULL &&
+       ThemeLoadHand(kf, dir, "Long Hand", &(theme->hands[0]), error) &&
+       ThemeLoadHand(kf, dir, "Short Hand", &(theme->hands[1]), error);
+  g_key_file_free(kf);
+  g_free(path);
+
+  if (!ok) {
+    ThemeFree(theme);
+    return NULL;
+  }
+
+  SvgSize(theme->dial, &width, &height);
+  theme->units = MAX(width, height);
+  if (theme->units <= 0)
+    theme->units = 1;
+
+  return theme;
+}
+
+static gdouble ThemeFactor(const clock_face_t *face)
+/* Pixels per theme unit: the dial fills the largest centred square */
+{
+  return MIN(face->width, face->height) / face->theme->units;
+}
+
+static cairo_surface_t *ThemeRasterize(RsvgHandle *svg, gdouble k,
+                                       gdouble scale) {
+  gdouble width, height;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  SvgSize(svg, &width, &height);
+  surface = RasterNew(CAIRO_FORMAT_ARGB32, width * k, height * k, scale);
+
+  cr = cairo_create(surface);
+  cairo_scale(cr, k, k);
+  SvgRender(svg, cr);
+  cairo_destroy(cr);
+
+  return surface;
+}
+
+static void ThemeRenderDial(clock_face_t *face, cairo_t *cr, gboolean vector) {
+  gdouble k = ThemeFactor(face);
+  gint size = MIN(face->width, face->height);
+
+  cairo_save(cr);
+  cairo_translate(cr, (face->width - size) / 2, (face->height - size) / 2);
+  if (vector) {
+    cairo_scale(cr, k, k);
+    SvgRender(face->theme->dial, cr);
+  } else {
+    /* Rasterized once per size and scale factor */
+    RasterLookup(face->dial != NULL);
+    if (face->dial == NULL)
+      face->dial = ThemeRasterize(face->theme->dial, k, face->scale);
+    cairo_set_source_surface(cr, face->dial, 0, 0);
+    cairo_paint(cr);
+  }
+  cairo_restore(cr);
+}
+
+static void ThemeRenderHands(clock_face_t *face, cairo_t *cr,
+                             gboolean vector) {
+  gdouble xc, yc, radius;
+  gdouble k = ThemeFactor(face);
+  theme_hand_t *hand;
+  gint i;
+
+  Geometry(face, &xc, &yc, &radius);
+
+  for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++) {
+    hand = &(face->theme->hands[i]);
+
+    /* A composite and two transforms: rotate about the centre, then put
+       the pivot on it */
+    cairo_save(cr);
+    cairo_translate(cr, xc, yc);
+    cairo_rotate(cr, face->ticks[i] * G_PI / 30.0);
+    cairo_translate(cr, -hand->pivotX * k, -hand->pivotY * k);
+    if (vector) {
+      cairo_scale(cr, k, k);
+      SvgRender(hand->svg, cr);
+    } else {
+      RasterLookup(hand->sprite != NULL);
+      if (hand->sprite == NULL)
+        hand->sprite = ThemeRasterize(hand->svg, k, face->scale);
+      cairo_set_source_surface(cr, hand->sprite, 0, 0);
+      cairo_paint(cr);
+    }
+    cairo_restore(cr);
+  }
+}
+#endif
+
+static gboolean IsVector(cairo_t *cr) {
+  switch (cairo_surface_get_type(cairo_get_target(cr))) {
+  case CAIRO_SURFACE_TYPE_PDF:
+  case CAIRO_SURFACE_TYPE_PS:
+  case CAIRO_SURFACE_TYPE_SVG:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+clock_face_t *clock_face_new(gint size, gdouble scale,
+                             clock_face_style_t style) {
+  clock_face_t *face = g_new0(clock_face_t, 1);
+
+  MarksInit();
+  face->width = size;
+  face->height = size;
+  face->scale = (scale > 0) ? scale : 1.0;
+  face->style = style;
+
+  return face;
+}
+
+void clock_face_free(clock_face_t *face) {
+  if (face == NULL)
+    return;
+  DropCaches(face);
+#ifdef HAVE_RSVG
+  ThemeFree(face->theme);
+#endif
+  g_free(face);
+}
+
+void clock_face_set_size(clock_face_t *face, gint width, gint height) {
+  if (face->width == width && face->height == height)
+    return;
+  face->width = width;
+  face->height = height;
+  DropCaches(face);
+}
+
+void clock_face_set_scale(clock_face_t *face, gdouble scale) {
+  if (scale <= 0 || face->scale == scale)
+    return;
+  face->scale = scale;
+  DropCaches(face);
+}
+
+gboolean clock_face_set_theme(clock_face_t *face, const gchar *dir,
+                              GError **error) {
+#ifdef HAVE_RSVG
+  theme_t *theme = NULL;
+
+  if (dir && *dir && !(theme = ThemeLoad(dir, error)))
+    return FALSE;
+
+  DropCaches(face);
+  ThemeFree(face->theme);
+  face->theme = theme;
+
+  return TRUE;
+#else
+  if (dir == NULL || *dir == '\0') {
+    DropCaches(face);
+    return TRUE;
+  }
+
+  g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+              "Clock face themes need librsvg support");
+  return FALSE;
+#endif
+}
+
+void clock_face_set_shared(clock_face_t *face, gboolean shared) {
+  if (face->shared == shared)
+    return;
+  DropCaches(face);
+  face->shared = shared;
+}
+
+void clock_face_set_time(clock_face_t *face, guint hr, guint min) {
+  /* The hour pointer moves 5 ticks an hour, and creeps with the minutes */
+  clock_face_set_ticks(face, min, (hr % 12) * 5 + min / 12.0);
+}
+
+void clock_face_set_ticks(clock_face_t *face, gdouble long_ticks,
+                          gdouble short_ticks) {
+  face->ticks[CLOCK_FACE_HAND_LONG] = long_ticks;
+  face->ticks[CLOCK_FACE_HAND_SHORT] = short_ticks;
+}
+
+void clock_face_render_dial(clock_face_t *face, cairo_t *cr) {
+  gdouble xc, yc, radius;
+
+  if (face->width <= 0 || face->height <= 0)
+    return;
+
+#ifdef HAVE_RSVG
+  if (face->theme) {
+    ThemeRenderDial(face, cr, IsVector(cr));
+    return;
+  }
+#endif
+
+  /* Keep vector output vector */
+  if (IsVector(cr)) {
+    Geometry(face, &xc, &yc, &radius);
+    DrawTicks(cr, xc, yc, radius);
+    return;
+  }
+
+  /* Rasterize the dial once per size and scale, then only composite it */
+  if (face->dial == NULL && face->shared) {
+    DialAcquire(face);
+  } else {
+    RasterLookup(face->dial != NULL);
+    if (face->dial == NULL)
+      face->dial = DialRasterize(face);
+  }
+
+  cairo_mask_surface(cr, face->dial, 0, 0);
+}
+
+void clock_face_render_hands(clock_face_t *face, cairo_t *cr) {
+  gdouble xc, yc, radius;
+  gint i;
+
+#ifdef HAVE_RSVG
+  if (face->theme) {
+    ThemeRenderHands(face, cr, IsVector(cr));
+    return;
+  }
+#endif
+
+  Geometry(face, &xc, &yc, &radius);
+
+  for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++)
+    DrawPointer(cr, xc, yc, radius, TICKS_TO_RADIANS(face->ticks[i]),
+                hand_scale[i], face->style == CLOCK_FACE_STYLE_LINE);
+}
+
+void clock_face_render(clock_face_t *face, cairo_t *cr) {
+  clock_face_render_dial(face, cr);
+  clock_face_render_hands(face, cr);
+}
+
+void clock_face_get_hand_region(clock_face_t *face, clock_face_hand_t hand,
+                                cairo_rectangle_int_t *rect) {
+  gdouble xc, yc, radius, angle, hub, pad;
+  gdouble xt, yt;
+
+  Geometry(face, &xc, &yc, &radius);
+
+#ifdef HAVE_RSVG
+  if (face->theme) {
+    /* Any rotation of a theme hand stays within its reach of the centre */
+    pad = face->theme->hands[hand].reach * ThemeFactor(face) + 1;
+    rect->x = floor(xc - pad);
+    rect->y = floor(yc - pad);
+    rect->width = ceil(xc + pad) - rect->x;
+    rect->height = ceil(yc + pad) - rect->y;
+    return;
+  }
+#endif
+
+  angle = TICKS_TO_RADIANS(face->ticks[hand]);
+  xt = xc + sin(angle) * radius * hand_scale[hand];
+  yt = yc + cos(angle) * radius * hand_scale[hand];
+
+  /* filled pointers start on a hub, lines have a stroke width; pad for
+     antialiasing either way */
+  hub = (face->style == CLOCK_FACE_STYLE_FILLED) ? radius * CLOCK_SCALE : 0;
+  pad = (face->style == CLOCK_FACE_STYLE_FILLED) ? 1 : 2;
+
+  rect->x = floor(MIN(xc - hub, xt) - pad);
+  rect->y = floor(MIN(yc - hub, yt) - pad);
+  rect->width = ceil(MAX(xc + hub, xt) + pad) - rect->x;
+  rect->height = ceil(MAX(yc + hub, yt) + pad) - rect->y;
+}
+
+void clock_face_get_stats(clock_face_stats_t *stats) {
+  G_LOCK(dials);
+  stats->shared = dials ? g_hash_table_size(dials) : 0;
+  G_UNLOCK(dials);
+
+  G_LOCK(stats);
+  stats->bytes = raster_bytes;
+  G_UNLOCK(stats);
+
+  stats->hits = g_atomic_int_get(&raster_hits);
+  stats->misses = g_atomic_int_get(&raster_misses);
+}
@@ -0,0 +1,110 @@
+/*
+ *  Headless analog clock face for the Xfce4 panel clock
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CLOCK_FACE_H
+#define CLOCK_FACE_H
+
+#include <cairo.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A clock face knows its size, device scale, pointer style and the
+ * position of its two pointers, and renders itself to any cairo_t with the
+ * current source.  It needs neither GTK nor a display.  The dial is
+ * rasterized once per size and scale and reused (PDF, PS and SVG targets
+ * get it as paths instead).  Faces are independent of each other and may
+ * be used from different threads, unless they share their dial.
+ */
+
+typedef enum clock_face_style_t {
+  CLOCK_FACE_STYLE_FILLED, /* Filled pointers around a round hub */
+  CLOCK_FACE_STYLE_LINE    /* Single stroke pointers */
+} clock_face_style_t;
+
+typedef enum clock_face_hand_t {
+  CLOCK_FACE_HAND_LONG, /* Minutes, or seconds for a stopwatch */
+  CLOCK_FACE_HAND_SHORT /* Hours, or minutes for a stopwatch */
+} clock_face_hand_t;
+
+typedef struct clock_face_t clock_face_t;
+
+clock_face_t *clock_face_new(gint size, gdouble scale,
+                             clock_face_style_t style);
+void clock_face_free(clock_face_t *face);
+
+/*
+ * Themes live in a directory holding a face.theme key file:
+ *
+ *   [Dial]
+ *   File=dial.svg
+ *
+ *   [Long Hand]
+ *   File=minute.svg
+ *   PivotX=5
+ *   PivotY=45
+ *
+ *   [Short Hand]
+ *   File=hour.svg
+ *
+ * Hands are drawn pointing at 12 in the dial's units and rotate about
+ * their pivot (default: bottom centre), which is placed on the dial
+ * centre.  A NULL or empty dir selects the built-in face.  On failure the
+ * current face is kept.  Needs librsvg.
+ */
+gboolean clock_face_set_theme(clock_face_t *face, const gchar *dir,
+                              GError **error);
+
+/*
+ * Faces of the same size and scale can use a single, process-wide copy of
+ * the built-in dial.  All faces sharing it must be used from one thread.
+ * Off by default.
+ */
+void clock_face_set_shared(clock_face_t *face, gboolean shared);
+
+void clock_face_set_size(clock_face_t *face, gint width, gint height);
+void clock_face_set_scale(clock_face_t *face, gdouble scale);
+
+/* Pointer positions, either as a time of day or in ticks (0-60) */
+void clock_face_set_time(clock_face_t *face, guint hr, guint min);
+void clock_face_set_ticks(clock_face_t *face, gdouble long_ticks,
+                          gdouble short_ticks);
+
+void clock_face_render_dial(clock_face_t *face, cairo_t *cr);
+void clock_face_render_hands(clock_face_t *face, cairo_t *cr);
+void clock_face_render(clock_face_t *face, cairo_t *cr);
+
+/* Area a pointer covers at its current position, in user units */
+void clock_face_get_hand_region(clock_face_t *face, clock_face_hand_t hand,
+                                cairo_rectangle_int_t *rect);
+
+typedef struct clock_face_stats_t {
+  guint shared; /* Dials in the shared cache */
+  gsize bytes;  /* Pixel memory of all live dial and hand rasters */
+  guint hits;   /* Renders that reused a dial or hand raster */
+  guint misses; /* Renders that had to rasterize one first */
+} clock_face_stats_t;
+
+/* Process-wide figures, for all faces */
+void clock_face_get_stats(clock_face_stats_t *stats);
+
+G_END_DECLS
+
+#endif /* CLOCK_FACE_H */
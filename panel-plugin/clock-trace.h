@@ -0,0 +1,69 @@
+/*
+ *  Trace marks for the analog clock plugin
+ *  Copyright (c) 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CLOCK_TRACE_H
+#define CLOCK_TRACE_H
+
+/*
+ * CLOCK_TRACE_BEGIN(name) starts a timed span, CLOCK_TRACE_END(name) closes
+ * it and emits a USDT probe applet_clock:name (argument: duration in ns)
+ * and/or a sysprof mark "applet-clock/name".  Without --enable-tracing, or
+ * without either backend, both expand to nothing.
+ */
+
+#if defined(ENABLE_TRACING) &&                                                 \
+    (defined(HAVE_SYS_SDT_H) || defined(HAVE_SYSPROF))
+
+#include <glib.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define CLOCK_TRACE_PROBE(name, dur) DTRACE_PROBE1(applet_clock, name, dur)
+#else
+#define CLOCK_TRACE_PROBE(name, dur)
+#endif
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#define CLOCK_TRACE_NOW() SYSPROF_CAPTURE_CURRENT_TIME
+#define CLOCK_TRACE_MARK(name, begin, dur)                                     \
+  sysprof_collector_mark(begin, dur, "applet-clock", name, NULL)
+#else
+#define CLOCK_TRACE_NOW() (g_get_monotonic_time() * 1000)
+#define CLOCK_TRACE_MARK(name, begin, dur)
+#endif
+
+#define CLOCK_TRACE_BEGIN(name) gint64 clock_trace_##name = CLOCK_TRACE_NOW()
+
+#define CLOCK_TRACE_END(name)                                                  \
+  G_STMT_START {                                                               \
+    gint64 clock_trace_dur = CLOCK_TRACE_NOW() - clock_trace_##name;           \
+    CLOCK_TRACE_PROBE(name, clock_trace_dur);                                  \
+    CLOCK_TRACE_MARK(#name, clock_trace_##name, clock_trace_dur);              \
+  }                                                                            \
+  G_STMT_END
+
+#else
+
+#define CLOCK_TRACE_BEGIN(name)
+#define CLOCK_TRACE_END(name)
+
+#endif /* ENABLE_TRACING */
+
+#endif /* CLOCK_TRACE_H */
@@ -33,17 +33,32 @@
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4util/libxfce4util.h>
 
-#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+#ifdef TFD_TIMER_CANCEL_ON_SET
+#define USE_TIMERFD
+#include <errno.h>
+#include <glib-unix.h>
+#include <unistd.h>
+#endif
+
+#include "clock-face.h"
+#include "clock-trace.h"
+
 #define BORDER 2
 
-#define CLOCK_SCALE 0.1
-#define TICKS_TO_RADIANS(x) (G_PI - (G_PI / 30.0) * (x))
-#define HOURS_TO_RADIANS(x, y)                                                 \
-  (G_PI - (G_PI / 6.0) * (((x) > 12 ? (x)-12 : (x)) + (y) / 60.0))
+#define TZ_DIR "/usr/share/zoneinfo"
+#define TZ_BATCH 64 /* zoneinfo entries scanned per idle iteration */
+
+#define WATCH_REFRESH_MS 200 /* Face refresh while a stopwatch runs */
+
+#define JUMP_THRESHOLD G_USEC_PER_SEC /* Wall clock skew taken as a jump */
 
 typedef struct gui_t {
   /* Configuration GUI widgets */
@@ -57,8 +72,47 @@ typedef struct gui_t {
   GtkWidget *wTimeFormat;
   GtkWidget *wShowTime;
   GtkWidget *wTimezone;
+  GtkWidget *wZones;
+  GtkWidget *wMode;
+  GtkWidget *wCountdown;
+  GtkWidget *wTheme;
+  GtkWidget *wThemeReset;
+  GtkWidget *wAlarms;
+  GtkWidget *wAlarmAdd;
+  GtkWidget *wAlarmRemove;
+  GtkListStore *alarmStore;
+  GtkCellRenderer *rAlarmTime;
+  GtkCellRenderer *rAlarmDays;
+  GtkCellRenderer *rAlarmText;
+  /* Timezone completion, filled from the zoneinfo tree at idle */
+  GtkListStore *tzStore;
+  GQueue *tzDirs;
+  GDir *tzDir;
+  gchar *tzPath;
+  guint iTzIdleId;
 } gui_t;
 
+enum {
+  ALARM_COLUMN_TIME,
+  ALARM_COLUMN_DAYS,
+  ALARM_COLUMN_TEXT,
+  ALARM_N_COLUMNS
+};
+
+typedef enum clock_mode_t {
+  CLOCK_MODE_CLOCK,
+  CLOCK_MODE_STOPWATCH,
+  CLOCK_MODE_COUNTDOWN
+} clock_mode_t;
+
+typedef struct alarm_t {
+  gint64 next; /* Next fire time, seconds since the epoch */
+  guint hr;
+  guint min;
+  guint days; /* Weekday mask, bit 0 is Monday; 0 fires once */
+  gchar *text;
+} alarm_t;
+
 typedef struct param_t {
   /* Configurable parameters */
   gchar *titleFont;
@@ -68,9 +122,14 @@ typedef struct param_t {
   gchar *title;
   gchar *dateFormat;
   gchar *timeFormat;
+  gchar *theme; /* Face theme directory, empty for the built-in face */
   gboolean showTime;
   gboolean showDate;
   gboolean showTitle;
+  clock_mode_t mode;
+  guint countdown; /* Countdown length in minutes */
+  GPtrArray *alarms; /* alarm_t, kept as a min-heap on next */
+  gchar *zones;      /* Extra tooltip timezones, comma separated */
 } param_t;
 
 typedef struct conf_t {
@@ -89,20 +148,192 @@ typedef struct monitor_t {
   GtkWidget *wImgBox;
   GtkWidget *wTime;
   GtkWidget *wClock;
+  XfcePanelPluginMode mode; /* Layout the widgets are attached in */
+  guint size;               /* Last panel size, 0 until the first one */
+  gint side;                /* Current size request of the face */
+  gint titleHeight;         /* Line heights of the label fonts, in pixels, */
+  gint dateHeight;          /* measured when the fonts change */
+  gint timeHeight;
+  GtkCssProvider *titleCss; /* Font providers attached to the labels, */
+  GtkCssProvider *dayCss;   /* owned by the shared context */
+  GtkCssProvider *dateCss;
+  GtkCssProvider *timeCss;
 } monitor_t;
 
+typedef struct calendar_t {
+  /* Month calendar popup, built on first hover or click and then kept */
+  GtkWidget *wWindow;
+  GtkWidget *wCalendar;
+  guint iPrewarmId;
+  gboolean pointerIn; /* Over the clock, whose click toggles the popup */
+} calendar_t;
+
+typedef struct watch_t {
+  /* Stopwatch/countdown state, timed on the monotonic clock */
+  clock_mode_t mode;  /* Mode the state below belongs to */
+  gint64 total;       /* Countdown length, microseconds */
+  gint64 elapsed;     /* Accumulated before the current run, microseconds */
+  gint64 start;       /* Monotonic time the current run started */
+  gboolean running;
+  guint shown;        /* Seconds currently shown in the time label */
+  guint iRefreshId;   /* Sub-second redraws while running and mapped */
+  guint iExpireId;    /* One-shot countdown expiry */
+} watch_t;
+
+typedef struct stats_t {
+  /* Cheap counters, dumped by the "stats" remote event */
+  guint64 wakeups; /* Timer callbacks */
+  guint64 draws;
+  guint64 labels; /* gtk_label_set_text() calls from the draw path */
+  guint64 skips;  /* Label already showed the right text */
+  gint64 drawMin; /* Draw times, microseconds */
+  gint64 drawMax;
+  gint64 drawTotal;
+  gint64 construct; /* clock_construct() time, microseconds */
+  gint64 ready;     /* Until the deferred startup stage was done */
+  guint64 rcWrites; /* Saves that reached the disk */
+  guint64 rcSkips;  /* Saves skipped, the rc file was up to date */
+  guint64 jumps;    /* Wall clock set, stepped or resumed from suspend */
+  gint64 skew;      /* Size of the last jump, microseconds */
+} stats_t;
+
+typedef struct zone_t {
+  gchar *name;   /* Label, the last part of the identifier */
+  GTimeZone *tz; /* Interned, see InternTimezone() */
+} zone_t;
+
+typedef struct tooltip_t {
+  /* Hover text, built on demand and kept until it can change */
+  GPtrArray *zones; /* zone_t, parsed from param_t.zones */
+  gchar *text;
+  gint64 expires; /* When text goes stale, seconds since the epoch */
+} tooltip_t;
+
 typedef struct analog_clock_t {
   XfcePanelPlugin *plugin;
   unsigned int iTimerId; /* Cyclic update */
   struct conf_t oConf;
   struct monitor_t oMonitor;
+  struct calendar_t oCalendar;
+  struct watch_t oWatch;
+  struct stats_t oStats;
+  struct tooltip_t oTooltip;
+  clock_face_t *face;
+  gchar *faceTheme; /* Theme currently loaded into face */
   guint day;
   guint month;
   guint hr;
   guint min;
   GTimeZone *tz;
+  guint iStartupId; /* Deferred part of clock_construct() */
+  gint64 started;   /* When clock_construct() was entered, monotonic */
+  gchar *rcHash;    /* Of the rc file as last read or written */
+  gint64 armedReal; /* Wall and monotonic time the timer was last armed */
+  gint64 armedMono; /* at, to tell when the wall clock jumped */
+#ifdef USE_TIMERFD
+  int iTimerFd; /* Wall clock timer, cancelled when the clock is set */
+  guint iTimerFdId;
+#endif
 } analog_clock_t;
 
+typedef struct font_t {
+  PangoFontDescription *desc;
+  GtkCssProvider *css; /* Label rule for the font */
+  gint height;         /* Line height in pixels, -1 until measured */
+} font_t;
+
+typedef struct shared_t {
+  /* What all clocks of the process have in common, see SharedRef() */
+  guint refs;
+  gchar *defaultFont;
+  GHashTable *fonts; /* Font name -> font_t */
+} shared_t;
+
+static struct shared_t *shared = NULL;
+
+static void FontFree(void *data) {
+  struct font_t *font = (struct font_t *)data;
+
+  pango_font_description_free(font->desc);
+  g_object_unref(font->css);
+  g_free(font);
+}
+
+static struct shared_t *SharedRef(void)
+/* Clocks of one process share their fonts, CSS providers and (in
+   clock-face.c) dial rasters.  The plugin is external
+   (X-XFCE-Internal=false), so every clock on a panel gets its own wrapper
+   process and this only pays off between the labels of one clock */
+{
+  GtkSettings *settings;
+
+  if (shared == NULL) {
+    shared = g_new0(shared_t, 1);
+    shared->fonts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          FontFree);
+
+    settings = gtk_settings_get_default();
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(settings),
+                                     "gtk-font-name"))
+      g_object_get(settings, "gtk-font-name", &(shared->defaultFont), NULL);
+    if (shared->defaultFont == NULL)
+      shared->defaultFont = g_strdup("Sans Bold 9.8");
+  }
+  shared->refs++;
+
+  return shared;
+}
+
+static void SharedUnref(void) {
+  if (--shared->refs > 0)
+    return;
+
+  g_hash_table_destroy(shared->fonts);
+  g_free(shared->defaultFont);
+  g_free(shared);
+  shared = NULL;
+}
+
+static struct font_t *SharedFont(const gchar *name)
+/* Parses a font name and builds its CSS once per process */
+{
+  struct font_t *font;
+  PangoFontDescription *desc;
+  gchar *css;
+
+  font = g_hash_table_lookup(shared->fonts, name);
+  if (font)
+    return font;
+
+  desc = pango_font_description_from_string(name);
+  css = g_strdup_printf(
+      "label { font-family: %s; \
+               font-size: %dpx; \
+               font-style: %s; \
+               font-weight: %s; \
+               text-align: center; \
+             }",
+      pango_font_description_get_family(desc),
+      pango_font_description_get_size(desc) / PANGO_SCALE,
+      (pango_font_description_get_style(desc) == PANGO_STYLE_ITALIC ||
+       pango_font_description_get_style(desc) == PANGO_STYLE_OBLIQUE)
+          ? "italic"
+          : "normal",
+      (pango_font_description_get_weight(desc) >= PANGO_WEIGHT_BOLD)
+          ? "bold"
+          : "normal");
+
+  font = g_new0(font_t, 1);
+  font->desc = desc;
+  font->css = gtk_css_provider_new();
+  gtk_css_provider_load_from_data(font->css, css, -1, NULL);
+  font->height = -1;
+  g_hash_table_insert(shared->fonts, g_strdup(name), font);
+  g_free(css);
+
+  return font;
+}
+
 static const gchar *GetWeekdayAsString(guint day) {
   switch (day) {
   case 1:
@@ -129,80 +360,131 @@ static void DisplayClock(struct analog_clock_t *poPlugin) {
   gtk_widget_queue_draw(poMonitor->wClock);
 }
 
-static void DrawTicks(cairo_t *cr, gdouble xc, gdouble yc, gdouble radius) {
-  gint i;
-  gdouble x, y, angle;
-
-  for (i = 0; i < 12; i++) {
-    /* calculate */
-    angle = HOURS_TO_RADIANS(i, 0);
-    x = xc + sin(angle) * (radius * (1.0 - CLOCK_SCALE));
-    y = yc + cos(angle) * (radius * (1.0 - CLOCK_SCALE));
+static void StatsLabel(struct stats_t *poStats, gboolean updated) {
+  if (updated)
+    poStats->labels++;
+  else
+    poStats->skips++;
+}
 
-    /* draw arc */
-    cairo_move_to(cr, x, y);
-    cairo_arc(cr, x, y, radius * CLOCK_SCALE, 0, 2 * G_PI);
-    cairo_close_path(cr);
-  }
+static void StatsDraw(struct stats_t *poStats, gint64 usec) {
+  if (poStats->draws == 0 || usec < poStats->drawMin)
+    poStats->drawMin = usec;
+  if (usec > poStats->drawMax)
+    poStats->drawMax = usec;
+  poStats->drawTotal += usec;
+  poStats->draws++;
+}
 
-  /* fill the arcs */
-  cairo_fill(cr);
+static void StatsReset(struct stats_t *poStats)
+/* Zeroes the running counters.  The startup times are measured only once
+   and the last wall clock jump stays on record */
+{
+  poStats->wakeups = 0;
+  poStats->draws = 0;
+  poStats->labels = 0;
+  poStats->skips = 0;
+  poStats->drawMin = 0;
+  poStats->drawMax = 0;
+  poStats->drawTotal = 0;
+  poStats->rcWrites = 0;
+  poStats->rcSkips = 0;
 }
 
-static void DrawPointer(cairo_t *cr, gdouble xc, gdouble yc, gdouble radius,
-                        gdouble angle, gdouble scale, gboolean line) {
-  gdouble xs, ys;
-  gdouble xt, yt;
+static void StatsDump(struct analog_clock_t *poPlugin) {
+  struct stats_t *poStats = &(poPlugin->oStats);
+  clock_face_stats_t faces;
+
+  clock_face_get_stats(&faces);
+
+  g_message("applet-clock %d: wakeups %" G_GUINT64_FORMAT
+            ", draws %" G_GUINT64_FORMAT ", label updates %" G_GUINT64_FORMAT
+            "/%" G_GUINT64_FORMAT
+            " skipped, draw time min/avg/max %" G_GINT64_FORMAT
+            "/%" G_GINT64_FORMAT "/%" G_GINT64_FORMAT
+            " us, startup %" G_GINT64_FORMAT "/%" G_GINT64_FORMAT
+            " us, rc writes %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT
+            " skipped, wall clock jumps %" G_GUINT64_FORMAT " (last %"
+            G_GINT64_FORMAT " us); process: %u clocks, %u fonts, %u shared"
+            " dials, %" G_GSIZE_FORMAT " bytes of rasters, raster cache %u"
+            " hits/%u misses",
+            xfce_panel_plugin_get_unique_id(poPlugin->plugin),
+            poStats->wakeups, poStats->draws, poStats->labels, poStats->skips,
+            poStats->drawMin,
+            poStats->draws ? poStats->drawTotal / (gint64)poStats->draws : 0,
+            poStats->drawMax, poStats->construct, poStats->ready,
+            poStats->rcWrites, poStats->rcSkips, poStats->jumps,
+            poStats->skew, shared->refs,
+            g_hash_table_size(shared->fonts), faces.shared, faces.bytes,
+            faces.hits, faces.misses);
+}
 
-  /* calculate tip position */
-  xt = xc + sin(angle) * radius * scale;
-  yt = yc + cos(angle) * radius * scale;
+static gint64 WatchElapsed(struct watch_t *poWatch) {
+  if (poWatch->running)
+    return poWatch->elapsed + g_get_monotonic_time() - poWatch->start;
+  return poWatch->elapsed;
+}
 
-  if (line) {
-    /* draw the line */
-    cairo_move_to(cr, xc, yc);
-    cairo_line_to(cr, xt, yt);
+static gint64 WatchShown(struct watch_t *poWatch)
+/* Time the watch face shows: elapsed, or remaining for a countdown */
+{
+  gint64 t = WatchElapsed(poWatch);
 
-    /* draw the line */
-    cairo_stroke(cr);
-  } else {
-    /* calculate start position */
-    xs = xc + sin(angle - 0.5 * G_PI) * radius * CLOCK_SCALE;
-    ys = yc + cos(angle - 0.5 * G_PI) * radius * CLOCK_SCALE;
+  if (poWatch->mode == CLOCK_MODE_COUNTDOWN)
+    t = MAX(poWatch->total - t, 0);
+  return t;
+}
 
-    /* draw the pointer */
-    cairo_move_to(cr, xs, ys);
-    cairo_arc(cr, xc, yc, radius * CLOCK_SCALE, -angle + G_PI, -angle);
-    cairo_line_to(cr, xt, yt);
-    cairo_close_path(cr);
+static void SetWatchHands(clock_face_t *face, gint64 t) {
+  /* long pointer sweeps the seconds, short pointer the minutes */
+  clock_face_set_ticks(face,
+                       (t % G_TIME_SPAN_MINUTE) / (gdouble)G_TIME_SPAN_SECOND,
+                       (t % G_TIME_SPAN_HOUR) / (gdouble)G_TIME_SPAN_MINUTE);
+}
 
-    /* fill the pointer */
-    cairo_fill(cr);
+static void SetWatchLabel(struct analog_clock_t *clock, gint64 t) {
+  struct watch_t *poWatch = &(clock->oWatch);
+  guint secs;
+  gchar time[16];
+
+  /* A countdown only reaches 00:00 when it actually expires */
+  if (poWatch->mode == CLOCK_MODE_COUNTDOWN)
+    secs = (t + G_TIME_SPAN_SECOND - 1) / G_TIME_SPAN_SECOND;
+  else
+    secs = t / G_TIME_SPAN_SECOND;
+
+  StatsLabel(&(clock->oStats), poWatch->shown != secs);
+  if (poWatch->shown != secs) {
+    if (secs >= 3600)
+      g_snprintf(time, sizeof(time), "%u:%02u:%02u", secs / 3600,
+                 (secs / 60) % 60, secs % 60);
+    else
+      g_snprintf(time, sizeof(time), "%02u:%02u", secs / 60, secs % 60);
+    gtk_label_set_text(GTK_LABEL(clock->oMonitor.wTime), time);
+    poWatch->shown = secs;
   }
 }
 
 static void draw_area_cb(GtkWidget *da, cairo_t *cr, gpointer pdata) {
-  gint w, h;
-  gdouble xc, yc;
-  gdouble radius;
-  double angle;
   GDateTime *date_time;
   guint hr, min;
   guint day, month;
   gchar weekday[4];
   gchar time[6];
   gchar date[6];
+  gint64 shown;
+  gint64 start = g_get_monotonic_time();
 
   struct analog_clock_t *clock = (struct analog_clock_t *)pdata;
   GtkStyleContext *css_context = gtk_widget_get_style_context(GTK_WIDGET(da));
 
-  w = gtk_widget_get_allocated_width(da);
-  h = gtk_widget_get_allocated_height(da);
-  xc = w / 2;
-  yc = h / 2;
-  radius = ((xc < yc) ? xc : yc);
+  clock_face_set_size(clock->face, gtk_widget_get_allocated_width(da),
+                      gtk_widget_get_allocated_height(da));
+  clock_face_set_scale(clock->face, gtk_widget_get_scale_factor(da));
 
-  DrawTicks(cr, xc, yc, radius);
+  CLOCK_TRACE_BEGIN(draw_face);
+  clock_face_render_dial(clock->face, cr);
+  CLOCK_TRACE_END(draw_face);
 
   /* get the local time */
   date_time = g_date_time_new_now(clock->tz);
@@ -210,22 +492,30 @@ static void draw_area_cb(GtkWidget *da, cairo_t *cr, gpointer pdata) {
   min = g_date_time_get_minute(date_time);
   day = g_date_time_get_day_of_month(date_time);
   month = g_date_time_get_month(date_time);
-
-  /* minute pointer */
-  angle = TICKS_TO_RADIANS(min);
-  DrawPointer(cr, xc, yc, radius, angle, 0.8, FALSE);
-
-  /* hour pointer */
-  angle = HOURS_TO_RADIANS(hr, min);
-  DrawPointer(cr, xc, yc, radius, angle, 0.5, FALSE);
-
-  if (clock->hr != hr || clock->min != min) {
-    g_snprintf(time, sizeof(time), "%02d:%02d", hr, min);
-    gtk_label_set_text(GTK_LABEL(clock->oMonitor.wTime), time);
-    clock->hr = hr;
-    clock->min = min;
+  shown = WatchShown(&(clock->oWatch));
+
+  CLOCK_TRACE_BEGIN(draw_hands);
+  if (clock->oWatch.mode != CLOCK_MODE_CLOCK)
+    SetWatchHands(clock->face, shown);
+  else
+    clock_face_set_time(clock->face, hr, min);
+  clock_face_render_hands(clock->face, cr);
+  CLOCK_TRACE_END(draw_hands);
+
+  CLOCK_TRACE_BEGIN(draw_labels);
+  if (clock->oWatch.mode != CLOCK_MODE_CLOCK) {
+    SetWatchLabel(clock, shown);
+  } else {
+    StatsLabel(&(clock->oStats), clock->hr != hr || clock->min != min);
+    if (clock->hr != hr || clock->min != min) {
+      g_snprintf(time, sizeof(time), "%02d:%02d", hr, min);
+      gtk_label_set_text(GTK_LABEL(clock->oMonitor.wTime), time);
+      clock->hr = hr;
+      clock->min = min;
+    }
   }
 
+  StatsLabel(&(clock->oStats), clock->day != day);
   if (clock->day != day) {
     gtk_label_set_text(
         GTK_LABEL(clock->oMonitor.wDay),
@@ -236,22 +526,417 @@ static void draw_area_cb(GtkWidget *da, cairo_t *cr, gpointer pdata) {
     clock->day = day;
     clock->month = month;
   }
+  CLOCK_TRACE_END(draw_labels);
 
   g_date_time_unref(date_time);
+
+  StatsDraw(&(clock->oStats), g_get_monotonic_time() - start);
+}
+
+static void AlarmFree(struct alarm_t *alarm) {
+  g_free(alarm->text);
+  g_free(alarm);
+}
+
+static gint64 AlarmNextFire(const struct alarm_t *alarm, GTimeZone *tz,
+                            gint64 after)
+/* First time strictly after 'after' at which the alarm goes off in tz */
+{
+  GDateTime *now, *day, *at;
+  gint64 next = G_MAXINT64;
+  gint i;
+
+  now = g_date_time_new_from_unix_utc(after);
+  day = g_date_time_to_timezone(now, tz);
+  g_date_time_unref(now);
+
+  /* A weekly alarm is at most a week away */
+  for (i = 0; i <= 7 && next == G_MAXINT64; i++) {
+    now = g_date_time_add_days(day, i);
+    at = g_date_time_new(tz, g_date_time_get_year(now),
+                         g_date_time_get_month(now),
+                         g_date_time_get_day_of_month(now), alarm->hr,
+                         alarm->min, 0);
+    g_date_time_unref(now);
+    if (at == NULL)
+      continue;
+
+    if (g_date_time_to_unix(at) > after &&
+        (alarm->days == 0 ||
+         (alarm->days & (1 << (g_date_time_get_day_of_week(at) - 1)))))
+      next = g_date_time_to_unix(at);
+    g_date_time_unref(at);
+  }
+  g_date_time_unref(day);
+
+  return next;
+}
+
+#define ALARM_AT(heap, i) ((struct alarm_t *)g_ptr_array_index(heap, i))
+
+static void AlarmHeapSwap(GPtrArray *heap, guint i, guint j) {
+  gpointer tmp = g_ptr_array_index(heap, i);
+  g_ptr_array_index(heap, i) = g_ptr_array_index(heap, j);
+  g_ptr_array_index(heap, j) = tmp;
+}
+
+static void AlarmHeapDown(GPtrArray *heap, guint i) {
+  guint child;
+
+  while ((child = 2 * i + 1) < heap->len) {
+    if (child + 1 < heap->len &&
+        ALARM_AT(heap, child + 1)->next < ALARM_AT(heap, child)->next)
+      child++;
+    if (ALARM_AT(heap, i)->next <= ALARM_AT(heap, child)->next)
+      break;
+    AlarmHeapSwap(heap, i, child);
+    i = child;
+  }
+}
+
+static void AlarmHeapPush(GPtrArray *heap, struct alarm_t *alarm) {
+  guint i, parent;
+
+  g_ptr_array_add(heap, alarm);
+  for (i = heap->len - 1; i > 0; i = parent) {
+    parent = (i - 1) / 2;
+    if (ALARM_AT(heap, parent)->next <= ALARM_AT(heap, i)->next)
+      break;
+    AlarmHeapSwap(heap, i, parent);
+  }
+}
+
+static struct alarm_t *AlarmHeapPop(GPtrArray *heap) {
+  struct alarm_t *top = ALARM_AT(heap, 0);
+
+  /* Moves the last element to the root */
+  g_ptr_array_remove_index_fast(heap, 0);
+  AlarmHeapDown(heap, 0);
+
+  return top;
+}
+
+static void RescheduleAlarms(struct analog_clock_t *poPlugin)
+/* Recompute every fire time, e.g. after a timezone change, and re-heapify */
+{
+  GPtrArray *heap = poPlugin->oConf.oParam.alarms;
+  gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+  guint i;
+
+  for (i = 0; i < heap->len; i++)
+    ALARM_AT(heap, i)->next =
+        AlarmNextFire(ALARM_AT(heap, i), poPlugin->tz, now);
+  for (i = heap->len / 2; i > 0; i--)
+    AlarmHeapDown(heap, i - 1);
+}
+
+static gint AlarmCompare(gconstpointer a, gconstpointer b) {
+  const struct alarm_t *x = *(const struct alarm_t **)a;
+  const struct alarm_t *y = *(const struct alarm_t **)b;
+
+  if (x->hr != y->hr)
+    return x->hr < y->hr ? -1 : 1;
+  if (x->min != y->min)
+    return x->min < y->min ? -1 : 1;
+  if (x->days != y->days)
+    return x->days < y->days ? -1 : 1;
+  return g_strcmp0(x->text, y->text);
 }
 
-static gboolean SetTimer(void *p_pvPlugin) {
+static GPtrArray *SortAlarms(GPtrArray *heap)
+/* A borrowed copy of the alarms by time of day.  The heap order depends on
+   the fire times and changes with every fire, this one does not */
+{
+  GPtrArray *sorted = g_ptr_array_sized_new(heap->len);
+  guint i;
+
+  for (i = 0; i < heap->len; i++)
+    g_ptr_array_add(sorted, g_ptr_array_index(heap, i));
+  g_ptr_array_sort(sorted, AlarmCompare);
+
+  return sorted;
+}
+
+static void ShowNotice(struct analog_clock_t *poPlugin, const gchar *text) {
+  GtkWidget *dlg;
+
+  dlg = gtk_message_dialog_new(NULL, 0, GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+                               "%s", text);
+  gtk_window_set_title(GTK_WINDOW(dlg), _("Analog Clock"));
+  gtk_window_set_screen(GTK_WINDOW(dlg),
+                        gtk_widget_get_screen(GTK_WIDGET(poPlugin->plugin)));
+  g_signal_connect(dlg, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+  gtk_widget_show(dlg);
+}
+
+static gboolean ClockTick(void *p_pvPlugin);
+static void SyncAlarmRows(struct analog_clock_t *poPlugin);
+static void InvalidateTooltip(struct analog_clock_t *poPlugin);
+
+static void SetTimer(void *p_pvPlugin)
+/* A single timer serves both the display and the alarms: it is armed for
+   the next minute boundary or the earliest alarm, whichever comes first.
+   Where possible it is a timerfd on the wall clock, which also wakes up
+   right away when the clock is set or resumes from suspend; otherwise a
+   monotonic timeout, and jumps are only noticed when it fires */
+{
   struct analog_clock_t *poPlugin = (analog_clock_t *)p_pvPlugin;
-  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  GPtrArray *heap = poPlugin->oConf.oParam.alarms;
+  gint64 now, deadline;
+#ifdef USE_TIMERFD
+  struct itimerspec its;
+#endif
+
+  now = g_get_real_time();
+  deadline = (now / G_TIME_SPAN_MINUTE + 1) * G_TIME_SPAN_MINUTE;
+  /* Compared in seconds: an alarm that never fires is G_MAXINT64 */
+  if (heap->len > 0 && ALARM_AT(heap, 0)->next < deadline / G_USEC_PER_SEC)
+    deadline = ALARM_AT(heap, 0)->next * G_USEC_PER_SEC;
+
+  poPlugin->armedReal = now;
+  poPlugin->armedMono = g_get_monotonic_time();
+
+#ifdef USE_TIMERFD
+  if (poPlugin->iTimerFd >= 0) {
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / G_USEC_PER_SEC;
+    its.it_value.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+    if (timerfd_settime(poPlugin->iTimerFd,
+                        TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its,
+                        NULL) == 0)
+      return;
+    /* Fall back to timeouts for good */
+    g_warning("Cannot arm the clock timer: %s", g_strerror(errno));
+    g_source_remove(poPlugin->iTimerFdId);
+    poPlugin->iTimerFdId = 0;
+    close(poPlugin->iTimerFd);
+    poPlugin->iTimerFd = -1;
+  }
+#endif
+
+  if (poPlugin->iTimerId)
+    g_source_remove(poPlugin->iTimerId);
+  poPlugin->iTimerId =
+      g_timeout_add(MAX(deadline - now, 0) / 1000 + 1, ClockTick, poPlugin);
+}
+
+static void ClockUpdate(struct analog_clock_t *poPlugin, gboolean jumped) {
+  GPtrArray *heap = poPlugin->oConf.oParam.alarms;
+  struct alarm_t *alarm;
+  gint64 real = g_get_real_time();
+  gint64 now = real / G_USEC_PER_SEC;
+  gint64 skew;
+  gboolean spent = FALSE;
+  CLOCK_TRACE_BEGIN(timer_wakeup);
+
+  poPlugin->oStats.wakeups++;
+
+  /* How far the wall clock ran ahead of (or behind) the monotonic one since
+     the timer was armed: a step, a settimeofday() or a suspend */
+  skew = (real - poPlugin->armedReal) -
+         (g_get_monotonic_time() - poPlugin->armedMono);
+
+  /* Alarms passed over by a jump forward still fire, late */
+  while (heap->len > 0 && ALARM_AT(heap, 0)->next <= now) {
+    alarm = AlarmHeapPop(heap);
+    ShowNotice(poPlugin, alarm->text);
+    if (alarm->days) {
+      alarm->next = AlarmNextFire(alarm, poPlugin->tz, now);
+      AlarmHeapPush(heap, alarm);
+    } else {
+      AlarmFree(alarm);
+      spent = TRUE;
+    }
+  }
+  /* Or the next edit in an open dialog would bring it back */
+  if (spent && poPlugin->oConf.wTopLevel)
+    SyncAlarmRows(poPlugin);
+
+  if (jumped || ABS(skew) > JUMP_THRESHOLD) {
+    /* Nothing derived from the old time can be trusted */
+    poPlugin->oStats.jumps++;
+    poPlugin->oStats.skew = skew;
+    InvalidateTooltip(poPlugin);
+    RescheduleAlarms(poPlugin);
+  }
 
   DisplayClock(poPlugin);
+  SetTimer(poPlugin);
 
-  if (poPlugin->iTimerId == 0) {
-    poPlugin->iTimerId = g_timeout_add(1000, (GSourceFunc)SetTimer, poPlugin);
-    return FALSE;
+  CLOCK_TRACE_END(timer_wakeup);
+}
+
+static gboolean ClockTick(void *p_pvPlugin) {
+  struct analog_clock_t *poPlugin = (analog_clock_t *)p_pvPlugin;
+
+  poPlugin->iTimerId = 0;
+  ClockUpdate(poPlugin, FALSE);
+
+  return FALSE;
+}
+
+#ifdef USE_TIMERFD
+static gboolean ClockTimerFdReady(gint fd, GIOCondition condition,
+                                  void *p_pvPlugin) {
+  struct analog_clock_t *poPlugin = (analog_clock_t *)p_pvPlugin;
+  guint64 expirations;
+
+  /* Reads fail with ECANCELED once the wall clock was set, including on
+     resume from suspend */
+  if (read(fd, &expirations, sizeof(expirations)) < 0) {
+    if (errno == ECANCELED)
+      ClockUpdate(poPlugin, TRUE);
+    return TRUE;
   }
+
+  ClockUpdate(poPlugin, FALSE);
   return TRUE;
 }
+#endif
+
+static gboolean WatchRefresh(void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  cairo_rectangle_int_t rect;
+  gint i;
+
+  poPlugin->oStats.wakeups++;
+
+  /* Only the pointers move: repaint where they are and where they go */
+  for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++) {
+    clock_face_get_hand_region(poPlugin->face, i, &rect);
+    gtk_widget_queue_draw_area(poPlugin->oMonitor.wClock, rect.x, rect.y,
+                               rect.width, rect.height);
+  }
+  SetWatchHands(poPlugin->face, WatchShown(&(poPlugin->oWatch)));
+  for (i = CLOCK_FACE_HAND_LONG; i <= CLOCK_FACE_HAND_SHORT; i++) {
+    clock_face_get_hand_region(poPlugin->face, i, &rect);
+    gtk_widget_queue_draw_area(poPlugin->oMonitor.wClock, rect.x, rect.y,
+                               rect.width, rect.height);
+  }
+
+  /* The time label is refreshed from the draw handler, once a second */
+  return TRUE;
+}
+
+static void WatchUpdateRefresh(struct analog_clock_t *poPlugin)
+/* Redraw several times a second only while a run is visible; paused or
+   unmapped watches cost nothing */
+{
+  struct watch_t *poWatch = &(poPlugin->oWatch);
+  gboolean want = poWatch->running && poWatch->mode != CLOCK_MODE_CLOCK &&
+                  gtk_widget_get_mapped(poPlugin->oMonitor.wClock);
+
+  if (want && poWatch->iRefreshId == 0) {
+    poWatch->iRefreshId =
+        g_timeout_add(WATCH_REFRESH_MS, WatchRefresh, poPlugin);
+  } else if (!want && poWatch->iRefreshId) {
+    g_source_remove(poWatch->iRefreshId);
+    poWatch->iRefreshId = 0;
+  }
+}
+
+static void clock_map_cb(GtkWidget *widget, void *data) {
+  WatchUpdateRefresh((struct analog_clock_t *)data);
+}
+
+static gboolean WatchExpire(void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct watch_t *poWatch = &(poPlugin->oWatch);
+
+  poPlugin->oStats.wakeups++;
+  poWatch->iExpireId = 0;
+  poWatch->elapsed = poWatch->total;
+  poWatch->running = FALSE;
+  WatchUpdateRefresh(poPlugin);
+  DisplayClock(poPlugin);
+  ShowNotice(poPlugin, _("Countdown finished"));
+
+  return FALSE;
+}
+
+static void WatchPause(struct analog_clock_t *poPlugin) {
+  struct watch_t *poWatch = &(poPlugin->oWatch);
+
+  poWatch->elapsed = WatchElapsed(poWatch);
+  poWatch->running = FALSE;
+  if (poWatch->iExpireId) {
+    g_source_remove(poWatch->iExpireId);
+    poWatch->iExpireId = 0;
+  }
+  WatchUpdateRefresh(poPlugin);
+  DisplayClock(poPlugin);
+}
+
+static void WatchStart(struct analog_clock_t *poPlugin) {
+  struct watch_t *poWatch = &(poPlugin->oWatch);
+
+  if (poWatch->running)
+    return;
+  if (poWatch->mode == CLOCK_MODE_COUNTDOWN) {
+    /* Restart a countdown that already ran out */
+    if (poWatch->elapsed >= poWatch->total)
+      poWatch->elapsed = 0;
+    if (poWatch->total == 0)
+      return;
+  }
+
+  poWatch->start = g_get_monotonic_time();
+  poWatch->running = TRUE;
+
+  /* Timeouts run on the monotonic clock, so this fires on time no matter
+     what happens to the wall clock or the timezone */
+  if (poWatch->mode == CLOCK_MODE_COUNTDOWN)
+    poWatch->iExpireId =
+        g_timeout_add((poWatch->total - poWatch->elapsed + 999) / 1000,
+                      WatchExpire, poPlugin);
+
+  WatchUpdateRefresh(poPlugin);
+  DisplayClock(poPlugin);
+}
+
+static void WatchReset(struct analog_clock_t *poPlugin) {
+  WatchPause(poPlugin);
+  poPlugin->oWatch.elapsed = 0;
+  DisplayClock(poPlugin);
+}
+
+static void SetMode(struct analog_clock_t *poPlugin) {
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct watch_t *poWatch = &(poPlugin->oWatch);
+  gint64 total = (gint64)poConf->countdown * G_TIME_SPAN_MINUTE;
+
+  /* Leave a running watch alone unless its settings changed */
+  if (poWatch->mode == poConf->mode && poWatch->total == total)
+    return;
+
+  WatchReset(poPlugin);
+  poWatch->mode = poConf->mode;
+  poWatch->total = total;
+
+  /* Force the time label to be redone for the new mode */
+  poWatch->shown = G_MAXUINT;
+  poPlugin->hr = G_MAXUINT;
+  DisplayClock(poPlugin);
+}
+
+static void SetTheme(struct analog_clock_t *poPlugin) {
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  GError *error = NULL;
+
+  /* Loading parses SVGs, only do it when the theme really changed */
+  if (g_strcmp0(poPlugin->faceTheme, poConf->theme) == 0)
+    return;
+
+  if (!clock_face_set_theme(poPlugin->face, poConf->theme, &error)) {
+    g_warning("Could not load clock theme %s: %s", poConf->theme,
+              error->message);
+    g_error_free(error);
+    clock_face_set_theme(poPlugin->face, NULL, NULL);
+  }
+  g_free(poPlugin->faceTheme);
+  poPlugin->faceTheme = g_strdup(poConf->theme);
+  DisplayClock(poPlugin);
+}
 
 static gboolean SetTitle(void *data) {
   struct analog_clock_t *poPlugin = (struct analog_clock_t*) data;
@@ -264,12 +949,155 @@ static gboolean SetTitle(void *data) {
   return TRUE;
 }
 
+static GTimeZone *InternTimezone(const gchar *identifier)
+/* Returns a shared, borrowed zone; each identifier is parsed only once.
+   NULL for an unknown identifier, which is not kept */
+{
+  static GHashTable *zones = NULL;
+  GTimeZone *tz;
+
+  if (G_UNLIKELY(zones == NULL))
+    zones = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)g_time_zone_unref);
+
+  tz = g_hash_table_lookup(zones, identifier);
+  if (tz == NULL) {
+#if GLIB_CHECK_VERSION(2, 68, 0)
+    tz = g_time_zone_new_identifier(identifier);
+    if (tz == NULL)
+      return NULL;
+#else
+    /* Older GLib cannot tell, unknown names come back as UTC */
+    tz = g_time_zone_new(identifier);
+#endif
+    g_hash_table_insert(zones, g_strdup(identifier), tz);
+  }
+
+  return tz;
+}
+
+static void ZoneFree(void *data) {
+  struct zone_t *zone = (struct zone_t *)data;
+
+  g_free(zone->name);
+  g_free(zone);
+}
+
+static void InvalidateTooltip(struct analog_clock_t *poPlugin) {
+  g_free(poPlugin->oTooltip.text);
+  poPlugin->oTooltip.text = NULL;
+}
+
+static void SetZones(struct analog_clock_t *poPlugin) {
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct tooltip_t *poTip = &(poPlugin->oTooltip);
+  struct zone_t *zone;
+  GTimeZone *tz;
+  gchar **ids, *id;
+  const gchar *name;
+  guint i;
+
+  if (poTip->zones)
+    g_ptr_array_free(poTip->zones, TRUE);
+  poTip->zones = g_ptr_array_new_with_free_func(ZoneFree);
+
+  ids = g_strsplit(poConf->zones, ",", -1);
+  for (i = 0; ids[i]; i++) {
+    id = g_strstrip(ids[i]);
+    if (*id == '\0')
+      continue;
+    if ((tz = InternTimezone(id)) == NULL) {
+      g_warning("Unknown timezone \"%s\" in the tooltip zones", id);
+      continue;
+    }
+
+    name = strrchr(id, '/');
+    zone = g_new0(zone_t, 1);
+    zone->name = g_strdelimit(g_strdup(name ? name + 1 : id), "_", ' ');
+    zone->tz = tz;
+    g_ptr_array_add(poTip->zones, zone);
+  }
+  g_strfreev(ids);
+
+  InvalidateTooltip(poPlugin);
+}
+
+static gchar *BuildTooltip(struct analog_clock_t *poPlugin, gint64 now,
+                           gint64 *expires) {
+  struct tooltip_t *poTip = &(poPlugin->oTooltip);
+  struct zone_t *zone;
+  GDateTime *utc, *local, *there;
+  GString *text;
+  gchar *s;
+  guint i, n;
+
+  utc = g_date_time_new_from_unix_utc(now);
+  local = g_date_time_to_timezone(utc, poPlugin->tz);
+
+  s = g_date_time_format(local, _("%A %e %B %Y\nWeek %V, UTC%:z"));
+  text = g_string_new(s);
+  g_free(s);
+
+  /* Zones are parsed at idle after startup, SetZones() drops this text */
+  n = poTip->zones ? poTip->zones->len : 0;
+  for (i = 0; i < n; i++) {
+    zone = g_ptr_array_index(poTip->zones, i);
+    there = g_date_time_to_timezone(utc, zone->tz);
+    s = g_date_time_format(there, "%H:%M %a");
+    g_string_append_printf(text, "\n%s: %s", zone->name, s);
+    g_free(s);
+    g_date_time_unref(there);
+  }
+
+  /* Times go stale at the next minute.  Without them the text holds until
+     the next local hour, the earliest the date or the offset can change */
+  if (n > 0)
+    *expires = now - now % 60 + 60;
+  else
+    *expires = now + (59 - g_date_time_get_minute(local)) * 60 +
+               (60 - g_date_time_get_second(local));
+
+  g_date_time_unref(local);
+  g_date_time_unref(utc);
+
+  return g_string_free(text, FALSE);
+}
+
+static gboolean clock_query_tooltip_cb(GtkWidget *widget, gint x, gint y,
+                                       gboolean keyboard, GtkTooltip *tooltip,
+                                       void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct tooltip_t *poTip = &(poPlugin->oTooltip);
+  gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+  if (poTip->text == NULL || now >= poTip->expires) {
+    g_free(poTip->text);
+    poTip->text = BuildTooltip(poPlugin, now, &(poTip->expires));
+  }
+  gtk_tooltip_set_text(tooltip, poTip->text);
+
+  return TRUE;
+}
+
 static gboolean SetTimezone(void* data) {
   struct analog_clock_t *poPlugin = (struct analog_clock_t*) data;
   struct param_t *poConf = &(poPlugin->oConf.oParam);
   struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  GTimeZone *tz;
 
-  poPlugin->tz = g_time_zone_new(poConf->timezone);
+  CLOCK_TRACE_BEGIN(tz_load);
+  tz = InternTimezone(poConf->timezone);
+  if (tz == NULL) {
+    g_warning("Unknown timezone \"%s\", using UTC", poConf->timezone);
+    tz = InternTimezone("UTC");
+  }
+  if (poPlugin->tz)
+    g_time_zone_unref(poPlugin->tz);
+  poPlugin->tz = g_time_zone_ref(tz);
+  CLOCK_TRACE_END(tz_load);
+  InvalidateTooltip(poPlugin);
+  RescheduleAlarms(poPlugin);
+  SetTimer(poPlugin);
   DisplayClock(poPlugin);
 
   return TRUE;
@@ -306,45 +1134,339 @@ static gboolean SetVisibilityDate(void *data) {
     gtk_widget_hide(poMonitor->wDate);
   }
 
-  return TRUE;
+  return TRUE;
+}
+
+static gboolean SetVisibilityTime(void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t*) data;
+  struct monitor_t *poMonitor = &(poPlugin->oMonitor);
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+
+  if (poConf->showTime == TRUE) {
+    gtk_widget_show(poMonitor->wTime);
+  } else {
+    gtk_widget_hide(poMonitor->wTime);
+  }
+
+  return TRUE;
+}
+
+static GtkWidget *create_label(const gchar *title) {
+  GtkWidget *label;
+
+  label = gtk_label_new("");
+  gtk_label_set_justify(GTK_LABEL(label), GTK_JUSTIFY_CENTER);
+  gtk_label_set_line_wrap(GTK_LABEL(label), FALSE);
+  gtk_widget_set_hexpand(GTK_WIDGET(label), TRUE);
+  gtk_label_set_text(GTK_LABEL(label), title);
+  return label;
+}
+
+static void Place(GtkWidget *grid, GtkWidget *child, gint x, gint y,
+                  gint height) {
+  gtk_container_child_set(GTK_CONTAINER(grid), child, "left-attach", x,
+                          "top-attach", y, "height", height, NULL);
+}
+
+static void SetLayout(struct analog_clock_t *poPlugin,
+                      XfcePanelPluginMode mode)
+/* Lays the widgets out for the panel mode.  A vertical panel gets a single
+ * column with the face between date and time, a horizontal panel a single
+ * row with the text after the face, so that it is never taller than one
+ * line; deskbar rows get the face on the left and the text in a column
+ * beside it. */
+{
+  struct monitor_t *poMonitor = &(poPlugin->oMonitor);
+  GtkWidget *grid = poMonitor->wBox;
+
+  if (mode == poMonitor->mode)
+    return;
+  poMonitor->mode = mode;
+
+  if (mode == XFCE_PANEL_PLUGIN_MODE_VERTICAL) {
+    Place(grid, poMonitor->wTitle, 0, 0, 1);
+    Place(grid, poMonitor->wDay, 0, 1, 1);
+    Place(grid, poMonitor->wDate, 0, 2, 1);
+    Place(grid, poMonitor->wClock, 0, 3, 1);
+    Place(grid, poMonitor->wTime, 0, 4, 1);
+  } else if (mode == XFCE_PANEL_PLUGIN_MODE_HORIZONTAL) {
+    Place(grid, poMonitor->wClock, 0, 0, 1);
+    Place(grid, poMonitor->wTitle, 1, 0, 1);
+    Place(grid, poMonitor->wDay, 2, 0, 1);
+    Place(grid, poMonitor->wDate, 3, 0, 1);
+    Place(grid, poMonitor->wTime, 4, 0, 1);
+  } else {
+    Place(grid, poMonitor->wClock, 0, 0, 4);
+    Place(grid, poMonitor->wTitle, 1, 0, 1);
+    Place(grid, poMonitor->wDay, 1, 1, 1);
+    Place(grid, poMonitor->wDate, 1, 2, 1);
+    Place(grid, poMonitor->wTime, 1, 3, 1);
+  }
+}
+
+static gint LineHeight(GtkWidget *label, const gchar *name)
+/* Measured as drawn: the label rule gives the size in whole pixels, see
+   SharedFont(), not in points */
+{
+  struct font_t *font = SharedFont(name);
+  PangoFontDescription *desc;
+  PangoFontMetrics *metrics;
+
+  if (font->height < 0) {
+    desc = pango_font_description_copy(font->desc);
+    pango_font_description_set_absolute_size(
+        desc, pango_font_description_get_size(font->desc) / PANGO_SCALE *
+                  PANGO_SCALE);
+    metrics = pango_context_get_metrics(gtk_widget_get_pango_context(label),
+                                        desc, NULL);
+    pango_font_description_free(desc);
+    font->height = (pango_font_metrics_get_ascent(metrics) +
+                    pango_font_metrics_get_descent(metrics)) /
+                   PANGO_SCALE;
+    pango_font_metrics_unref(metrics);
+  }
+
+  return font->height;
+}
+
+static void UpdateSize(struct analog_clock_t *poPlugin)
+/* Sizes the face for the current panel size and layout.  On a deskbar row
+ * the face is only as tall as the text column beside it, otherwise it fills
+ * the panel thickness.  The request only changes when the result does. */
+{
+  struct monitor_t *poMonitor = &(poPlugin->oMonitor);
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  gint side, text = 0, lines = 0;
+
+  if (poMonitor->size == 0)
+    return;
+
+  side = poMonitor->size - BORDER;
+  if (poMonitor->mode == XFCE_PANEL_PLUGIN_MODE_DESKBAR) {
+    if (poConf->showTitle) {
+      text += poMonitor->titleHeight;
+      lines++;
+    }
+    if (poConf->showDate) {
+      text += 2 * poMonitor->dateHeight;
+      lines += 2;
+    }
+    if (poConf->showTime) {
+      text += poMonitor->timeHeight;
+      lines++;
+    }
+    /* The heights are only measured in the idle startup stage, see
+       SetMonitorFont(); until then keep the full size, not a sliver */
+    if (lines > 0 && poMonitor->titleHeight > 0 &&
+        poMonitor->dateHeight > 0 && poMonitor->timeHeight > 0)
+      side = MIN(side, text + (lines - 1) * BORDER);
+  }
+  side = MAX(side, 1);
+
+  if (side == poMonitor->side)
+    return;
+  poMonitor->side = side;
+  gtk_widget_set_size_request(GTK_WIDGET(poMonitor->wClock), side, side);
+}
+
+static gboolean CalendarKeyPress(GtkWidget *window, GdkEventKey *event,
+                                 void *data);
+static gboolean CalendarFocusOut(GtkWidget *window, GdkEventFocus *event,
+                                 void *data);
+static gboolean CalendarDelete(GtkWidget *window, GdkEvent *event,
+                               void *data);
+
+static void CreateCalendar(struct analog_clock_t *poPlugin) {
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
+  GtkWidget *window;
+
+  if (poCal->wWindow)
+    return;
+
+  window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_type_hint(GTK_WINDOW(window), GDK_WINDOW_TYPE_HINT_UTILITY);
+  gtk_window_set_decorated(GTK_WINDOW(window), FALSE);
+  gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
+  gtk_window_set_skip_taskbar_hint(GTK_WINDOW(window), TRUE);
+  gtk_window_set_skip_pager_hint(GTK_WINDOW(window), TRUE);
+  gtk_window_stick(GTK_WINDOW(window));
+  gtk_window_set_screen(GTK_WINDOW(window),
+                        gtk_widget_get_screen(GTK_WIDGET(poPlugin->plugin)));
+  /* Every way out goes through HideCalendar(), which unblocks autohide */
+  g_signal_connect(window, "delete-event", G_CALLBACK(CalendarDelete),
+                   poPlugin);
+  g_signal_connect(window, "key-press-event", G_CALLBACK(CalendarKeyPress),
+                   poPlugin);
+  g_signal_connect(window, "focus-out-event", G_CALLBACK(CalendarFocusOut),
+                   poPlugin);
+
+  /* GtkCalendar pages through months by itself, nothing is rebuilt */
+  poCal->wCalendar = gtk_calendar_new();
+  gtk_calendar_set_display_options(GTK_CALENDAR(poCal->wCalendar),
+                                   GTK_CALENDAR_SHOW_HEADING |
+                                       GTK_CALENDAR_SHOW_DAY_NAMES |
+                                       GTK_CALENDAR_SHOW_WEEK_NUMBERS);
+  gtk_container_add(GTK_CONTAINER(window), poCal->wCalendar);
+  gtk_widget_show(poCal->wCalendar);
+
+  /* Realize now so that showing it later is only a map */
+  gtk_widget_realize(window);
+  poCal->wWindow = window;
+}
+
+static gboolean PrewarmCalendar(void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+
+  poPlugin->oCalendar.iPrewarmId = 0;
+  CreateCalendar(poPlugin);
+
+  return FALSE;
+}
+
+static void ShowCalendar(struct analog_clock_t *poPlugin) {
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
+  GDateTime *now;
+  gint x, y;
+
+  CreateCalendar(poPlugin);
+
+  /* Jump back to today in the configured timezone */
+  now = g_date_time_new_now(poPlugin->tz);
+  gtk_calendar_select_month(GTK_CALENDAR(poCal->wCalendar),
+                            g_date_time_get_month(now) - 1,
+                            g_date_time_get_year(now));
+  gtk_calendar_select_day(GTK_CALENDAR(poCal->wCalendar),
+                          g_date_time_get_day_of_month(now));
+  g_date_time_unref(now);
+
+  xfce_panel_plugin_position_widget(poPlugin->plugin, poCal->wWindow, NULL, &x,
+                                    &y);
+  gtk_window_move(GTK_WINDOW(poCal->wWindow), x, y);
+  gtk_window_present(GTK_WINDOW(poCal->wWindow));
+  xfce_panel_plugin_block_autohide(poPlugin->plugin, TRUE);
+}
+
+static void HideCalendar(struct analog_clock_t *poPlugin) {
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
+
+  if (poCal->wWindow && gtk_widget_get_visible(poCal->wWindow)) {
+    gtk_widget_hide(poCal->wWindow);
+    xfce_panel_plugin_block_autohide(poPlugin->plugin, FALSE);
+  }
+}
+
+static void DestroyCalendar(struct analog_clock_t *poPlugin) {
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
+
+  if (poCal->iPrewarmId) {
+    g_source_remove(poCal->iPrewarmId);
+    poCal->iPrewarmId = 0;
+  }
+  if (poCal->wWindow) {
+    HideCalendar(poPlugin);
+    gtk_widget_destroy(poCal->wWindow);
+    poCal->wWindow = NULL;
+    poCal->wCalendar = NULL;
+  }
+}
+
+static gboolean CalendarKeyPress(GtkWidget *window, GdkEventKey *event,
+                                 void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+
+  if (event->keyval == GDK_KEY_Escape) {
+    HideCalendar(poPlugin);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean CalendarFocusOut(GtkWidget *window, GdkEventFocus *event,
+                                 void *data)
+/* Clicking anywhere else closes the popup.  A click on the clock itself is
+   left to clock_button_press_cb(), or it would just reopen it */
+{
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+
+  if (!poPlugin->oCalendar.pointerIn)
+    HideCalendar(poPlugin);
+
+  return FALSE;
+}
+
+static gboolean CalendarDelete(GtkWidget *window, GdkEvent *event,
+                               void *data) {
+  HideCalendar((struct analog_clock_t *)data);
+
+  return TRUE;
+}
+
+static gboolean clock_enter_cb(GtkWidget *widget, GdkEventCrossing *event,
+                               void *data)
+/* The pointer is over the clock, a click may follow: build the popup in the
+   next idle so it is ready by then.  Clocks nobody touches never pay for it */
+{
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
+
+  poCal->pointerIn = TRUE;
+  if (poPlugin->oWatch.mode == CLOCK_MODE_CLOCK && poCal->wWindow == NULL &&
+      poCal->iPrewarmId == 0)
+    poCal->iPrewarmId = g_idle_add(PrewarmCalendar, poPlugin);
+
+  return FALSE;
+}
+
+static gboolean clock_leave_cb(GtkWidget *widget, GdkEventCrossing *event,
+                               void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+
+  poPlugin->oCalendar.pointerIn = FALSE;
+
+  return FALSE;
 }
 
-static gboolean SetVisibilityTime(void *data) {
-  struct analog_clock_t *poPlugin = (struct analog_clock_t*) data;
-  struct monitor_t *poMonitor = &(poPlugin->oMonitor);
-  struct param_t *poConf = &(poPlugin->oConf.oParam);
-  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+static gboolean clock_button_press_cb(GtkWidget *widget, GdkEventButton *event,
+                                      void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct calendar_t *poCal = &(poPlugin->oCalendar);
 
-  if (poConf->showTime == TRUE) {
-    gtk_widget_show(poMonitor->wTime);
-  } else {
-    gtk_widget_hide(poMonitor->wTime);
+  if (event->type != GDK_BUTTON_PRESS)
+    return FALSE;
+
+  /* Stopwatch and countdown: left click starts/pauses, middle click resets */
+  if (poPlugin->oWatch.mode != CLOCK_MODE_CLOCK) {
+    if (event->button == 1 && poPlugin->oWatch.running)
+      WatchPause(poPlugin);
+    else if (event->button == 1)
+      WatchStart(poPlugin);
+    else if (event->button == 2)
+      WatchReset(poPlugin);
+    else
+      return FALSE;
+    return TRUE;
   }
 
-  return TRUE;
-}
+  if (event->button != 1)
+    return FALSE;
 
-static GtkWidget *create_label(const gchar *title) {
-  GtkWidget *label;
+  if (poCal->wWindow && gtk_widget_get_visible(poCal->wWindow))
+    HideCalendar(poPlugin);
+  else
+    ShowCalendar(poPlugin);
 
-  label = gtk_label_new("");
-  gtk_label_set_justify(GTK_LABEL(label), GTK_JUSTIFY_CENTER);
-  gtk_label_set_line_wrap(GTK_LABEL(label), FALSE);
-  gtk_widget_set_hexpand(GTK_WIDGET(label), TRUE);
-  gtk_label_set_text(GTK_LABEL(label), title);
-  return label;
+  return TRUE;
 }
 
 static analog_clock_t *clock_create_control(XfcePanelPlugin *plugin) {
   struct analog_clock_t *poPlugin;
   struct param_t *poConf;
   struct monitor_t *poMonitor;
-  GtkOrientation orientation = xfce_panel_plugin_get_orientation(plugin);
-  GtkSettings *settings;
-  gchar *default_font;
+  struct shared_t *poShared;
 
   GtkStyleContext *context;
-  GtkCssProvider *css_provider;
 
   poPlugin = g_new(analog_clock_t, 1);
   memset(poPlugin, 0, sizeof(analog_clock_t));
@@ -352,6 +1474,9 @@ static analog_clock_t *clock_create_control(XfcePanelPlugin *plugin) {
   poMonitor = &(poPlugin->oMonitor);
 
   poPlugin->plugin = plugin;
+  poPlugin->face = clock_face_new(0, 1.0, CLOCK_FACE_STYLE_FILLED);
+  /* Every clock of the process draws from the main loop */
+  clock_face_set_shared(poPlugin->face, TRUE);
 
   poPlugin->iTimerId = 0;
 
@@ -362,117 +1487,127 @@ static analog_clock_t *clock_create_control(XfcePanelPlugin *plugin) {
   poConf->showTime = TRUE;
   poConf->dateFormat = g_strdup("%e/%m");
   poConf->timeFormat = g_strdup("%H:%M");
-
-  poPlugin->tz = g_time_zone_new(poConf->timezone);
+  poConf->theme = g_strdup("");
+  poConf->mode = CLOCK_MODE_CLOCK;
+  poConf->countdown = 5;
+  poConf->alarms = g_ptr_array_new();
+  poConf->zones = g_strdup("");
+
+  /* The timezone is loaded once the configuration is known */
+  poPlugin->tz = NULL;
+
+#ifdef USE_TIMERFD
+  poPlugin->iTimerFd =
+      timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (poPlugin->iTimerFd >= 0)
+    poPlugin->iTimerFdId = g_unix_fd_add(poPlugin->iTimerFd, G_IO_IN,
+                                         ClockTimerFdReady, poPlugin);
+#endif
   poPlugin->day = 0;
   poPlugin->month = 0;
   poPlugin->hr = 0;
   poPlugin->min = 0;
 
-  settings = gtk_settings_get_default();
-  if (g_object_class_find_property(G_OBJECT_GET_CLASS(settings),
-                                   "gtk-font-name")) {
-    g_object_get(settings, "gtk-font-name", &default_font, NULL);
-    poConf->titleFont = g_strdup(default_font);
-    poConf->timeFont = g_strdup(default_font);
-    poConf->dateFont = g_strdup(default_font);
-  } else {
-    poConf->titleFont = g_strdup("Sans Bold 9.8");
-    poConf->timeFont = g_strdup("Sans Bold 9.8");
-    poConf->dateFont = g_strdup("Sans Bold 9.8");
-  }
+  poShared = SharedRef();
+  poConf->titleFont = g_strdup(poShared->defaultFont);
+  poConf->timeFont = g_strdup(poShared->defaultFont);
+  poConf->dateFont = g_strdup(poShared->defaultFont);
 
   poMonitor->wEventBox = gtk_event_box_new();
   gtk_event_box_set_visible_window(GTK_EVENT_BOX(poMonitor->wEventBox), FALSE);
+  gtk_widget_add_events(poMonitor->wEventBox,
+                        GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
+  g_signal_connect(poMonitor->wEventBox, "enter-notify-event",
+                   G_CALLBACK(clock_enter_cb), poPlugin);
+  g_signal_connect(poMonitor->wEventBox, "leave-notify-event",
+                   G_CALLBACK(clock_leave_cb), poPlugin);
+  g_signal_connect(poMonitor->wEventBox, "button-press-event",
+                   G_CALLBACK(clock_button_press_cb), poPlugin);
+  gtk_widget_set_has_tooltip(poMonitor->wEventBox, TRUE);
+  g_signal_connect(poMonitor->wEventBox, "query-tooltip",
+                   G_CALLBACK(clock_query_tooltip_cb), poPlugin);
   gtk_widget_show(poMonitor->wEventBox);
 
   xfce_panel_plugin_add_action_widget(plugin, poMonitor->wEventBox);
 
-  poMonitor->wBox = gtk_box_new(GTK_ORIENTATION_VERTICAL, BORDER);
+  poMonitor->wBox = gtk_grid_new();
+  gtk_grid_set_row_spacing(GTK_GRID(poMonitor->wBox), BORDER);
+  gtk_grid_set_column_spacing(GTK_GRID(poMonitor->wBox), BORDER);
   context = gtk_widget_get_style_context(poMonitor->wBox);
   gtk_style_context_add_class(context, "clock_plugin");
   gtk_widget_show(poMonitor->wBox);
   gtk_container_set_border_width(GTK_CONTAINER(poMonitor->wBox), 0);
   gtk_container_add(GTK_CONTAINER(poMonitor->wEventBox), poMonitor->wBox);
 
+  /* Widgets start out in the vertical layout, SetLayout() moves them */
+  poMonitor->mode = XFCE_PANEL_PLUGIN_MODE_VERTICAL;
+
   /* Add Title */
   poMonitor->wTitle = create_label(poConf->title);
-  gtk_box_pack_start(GTK_BOX(poMonitor->wBox), GTK_WIDGET(poMonitor->wTitle),
-                     TRUE, FALSE, 0);
+  gtk_grid_attach(GTK_GRID(poMonitor->wBox), poMonitor->wTitle, 0, 0, 1, 1);
   gtk_widget_show(poMonitor->wTitle);
 
   /* Add day */
   poMonitor->wDay = create_label(GetWeekdayAsString(poPlugin->day));
-  gtk_box_pack_start(GTK_BOX(poMonitor->wBox), GTK_WIDGET(poMonitor->wDay),
-                     TRUE, FALSE, 0);
+  gtk_grid_attach(GTK_GRID(poMonitor->wBox), poMonitor->wDay, 0, 1, 1, 1);
   gtk_widget_show(poMonitor->wDay);
 
   /* Add date */
   poMonitor->wDate = create_label("00/00");
-  gtk_box_pack_start(GTK_BOX(poMonitor->wBox), GTK_WIDGET(poMonitor->wDate),
-                     TRUE, FALSE, 0);
+  gtk_grid_attach(GTK_GRID(poMonitor->wBox), poMonitor->wDate, 0, 2, 1, 1);
   gtk_widget_show(poMonitor->wDate);
 
   /* Add Image */
   poMonitor->wClock = gtk_drawing_area_new();
-  gtk_box_pack_start(GTK_BOX(poMonitor->wBox), GTK_WIDGET(poMonitor->wClock),
-                     TRUE, FALSE, 0);
+  gtk_widget_set_halign(poMonitor->wClock, GTK_ALIGN_CENTER);
+  gtk_widget_set_valign(poMonitor->wClock, GTK_ALIGN_CENTER);
+  gtk_grid_attach(GTK_GRID(poMonitor->wBox), poMonitor->wClock, 0, 3, 1, 1);
   g_signal_connect(poMonitor->wClock, "draw", G_CALLBACK(draw_area_cb),
                    poPlugin);
+  g_signal_connect(poMonitor->wClock, "map", G_CALLBACK(clock_map_cb),
+                   poPlugin);
+  g_signal_connect(poMonitor->wClock, "unmap", G_CALLBACK(clock_map_cb),
+                   poPlugin);
   gtk_widget_show(poMonitor->wClock);
 
   /* Add Time */
   poMonitor->wTime = create_label("00:00");
-  gtk_box_pack_start(GTK_BOX(poMonitor->wBox), GTK_WIDGET(poMonitor->wTime),
-                     TRUE, FALSE, 0);
+  gtk_grid_attach(GTK_GRID(poMonitor->wBox), poMonitor->wTime, 0, 4, 1, 1);
   gtk_widget_show(poMonitor->wTime);
 
-  css_provider = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css_provider,
-                                  "label: { text-align: center; }", -1, NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wTitle))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  gtk_css_provider_load_from_data(css_provider,
-                                  "label: { text-align: center; }", -1, NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wDay))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  gtk_css_provider_load_from_data(css_provider,
-                                  "label: { text-align: center; }", -1, NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wDate))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  css_provider = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css_provider,
-                                  "label: { text-align: center; }", -1, NULL);
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wTime))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  gtk_style_context_add_provider(GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-                                     GTK_WIDGET(poMonitor->wClock))),
-                                 GTK_STYLE_PROVIDER(css_provider),
-                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  g_free(default_font);
-
   return poPlugin;
 }
 
+static void StopFillTimezones(struct gui_t *);
 static void clock_free(XfcePanelPlugin *plugin, analog_clock_t *poPlugin) {
+  guint i;
+
   TRACE("clock_free()\n");
 
   if (poPlugin->iTimerId)
     g_source_remove(poPlugin->iTimerId);
-  g_free(poPlugin->tz);
+#ifdef USE_TIMERFD
+  if (poPlugin->iTimerFdId)
+    g_source_remove(poPlugin->iTimerFdId);
+  if (poPlugin->iTimerFd >= 0)
+    close(poPlugin->iTimerFd);
+#endif
+  if (poPlugin->tz)
+    g_time_zone_unref(poPlugin->tz);
+  if (poPlugin->iStartupId)
+    g_source_remove(poPlugin->iStartupId);
+
+  DestroyCalendar(poPlugin);
+  if (poPlugin->oWatch.iRefreshId)
+    g_source_remove(poPlugin->oWatch.iRefreshId);
+  if (poPlugin->oWatch.iExpireId)
+    g_source_remove(poPlugin->oWatch.iExpireId);
+
+  StopFillTimezones(&(poPlugin->oConf.oGUI));
+  if (poPlugin->oConf.oGUI.tzStore)
+    g_object_unref(poPlugin->oConf.oGUI.tzStore);
+  if (poPlugin->oConf.wTopLevel)
+    gtk_widget_destroy(poPlugin->oConf.wTopLevel);
 
   g_free(poPlugin->oConf.oParam.titleFont);
   g_free(poPlugin->oConf.oParam.dateFont);
@@ -481,45 +1616,39 @@ static void clock_free(XfcePanelPlugin *plugin, analog_clock_t *poPlugin) {
   g_free(poPlugin->oConf.oParam.timezone);
   g_free(poPlugin->oConf.oParam.dateFormat);
   g_free(poPlugin->oConf.oParam.timeFormat);
+  g_free(poPlugin->oConf.oParam.theme);
+  g_free(poPlugin->faceTheme);
+  g_free(poPlugin->rcHash);
+  for (i = 0; i < poPlugin->oConf.oParam.alarms->len; i++)
+    AlarmFree(ALARM_AT(poPlugin->oConf.oParam.alarms, i));
+  g_ptr_array_free(poPlugin->oConf.oParam.alarms, TRUE);
+  g_free(poPlugin->oConf.oParam.zones);
+  if (poPlugin->oTooltip.zones)
+    g_ptr_array_free(poPlugin->oTooltip.zones, TRUE);
+  g_free(poPlugin->oTooltip.text);
+  clock_face_free(poPlugin->face);
   g_free(poPlugin);
+  SharedUnref();
 }
 
-static void SetFont(GtkWidget *widget, const gchar *name) {
-  GtkCssProvider *css_provider = NULL;
-  gchar *css = NULL;
-  PangoFontDescription *font = NULL;
-
-  font = pango_font_description_from_string(name);
-  if (G_LIKELY(font)) {
-    css = g_strdup_printf(
-        "label { font-family: %s; \
-                 font-size: %dpx; \
-                 font-style: %s; \
-                 font-weight: %s; \
-                 text-align: center; \
-               }",
-        pango_font_description_get_family(font),
-        pango_font_description_get_size(font) / PANGO_SCALE,
-        (pango_font_description_get_style(font) == PANGO_STYLE_ITALIC ||
-         pango_font_description_get_style(font) == PANGO_STYLE_OBLIQUE)
-            ? "italic"
-            : "normal",
-        (pango_font_description_get_weight(font) >= PANGO_WEIGHT_BOLD)
-            ? "bold"
-            : "normal");
-    pango_font_description_free(font);
-  } else {
-    css = g_strdup_printf("label { font: %s; }", name);
+static void SetFont(GtkWidget *widget, const gchar *name,
+                    GtkCssProvider **attached)
+/* Swaps the label's font provider for the shared one of the font */
+{
+  struct font_t *font = SharedFont(name);
+  GtkStyleContext *context = gtk_widget_get_style_context(widget);
+  CLOCK_TRACE_BEGIN(css_reload);
+
+  if (*attached != font->css) {
+    if (*attached)
+      gtk_style_context_remove_provider(context,
+                                        GTK_STYLE_PROVIDER(*attached));
+    gtk_style_context_add_provider(context, GTK_STYLE_PROVIDER(font->css),
+                                   GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    *attached = font->css;
   }
 
-  css_provider = gtk_css_provider_new();
-  gtk_css_provider_load_from_data(css_provider, css, strlen(css), NULL);
-  gtk_style_context_add_provider(
-      GTK_STYLE_CONTEXT(gtk_widget_get_style_context(widget)),
-      GTK_STYLE_PROVIDER(css_provider),
-      GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-  g_free(css);
+  CLOCK_TRACE_END(css_reload);
 }
 
 static int SetMonitorFont(void *p_pvPlugin) {
@@ -527,14 +1656,103 @@ static int SetMonitorFont(void *p_pvPlugin) {
   struct monitor_t *poMonitor = &(poPlugin->oMonitor);
   struct param_t *poConf = &(poPlugin->oConf.oParam);
 
-  SetFont(poMonitor->wTitle, poConf->titleFont);
-  SetFont(poMonitor->wDay, poConf->dateFont);
-  SetFont(poMonitor->wDate, poConf->dateFont);
-  SetFont(poMonitor->wTime, poConf->timeFont);
+  SetFont(poMonitor->wTitle, poConf->titleFont, &(poMonitor->titleCss));
+  SetFont(poMonitor->wDay, poConf->dateFont, &(poMonitor->dayCss));
+  SetFont(poMonitor->wDate, poConf->dateFont, &(poMonitor->dateCss));
+  SetFont(poMonitor->wTime, poConf->timeFont, &(poMonitor->timeCss));
+
+  poMonitor->titleHeight = LineHeight(poMonitor->wTitle, poConf->titleFont);
+  poMonitor->dateHeight = LineHeight(poMonitor->wDate, poConf->dateFont);
+  poMonitor->timeHeight = LineHeight(poMonitor->wTime, poConf->timeFont);
 
   return 0;
 }
 
+static void RcEntry(GString *rc, const gchar *key, const gchar *value)
+/* Appends key=value, escaped the way XfceRc unescapes it */
+{
+  const gchar *p, *end;
+
+  g_string_append_printf(rc, "%s=", key);
+  /* Leading and trailing blanks would be trimmed on reading */
+  for (p = value ? value : ""; *p == ' '; p++)
+    g_string_append(rc, "\\ ");
+  for (end = p + strlen(p); end > p && end[-1] == ' '; end--)
+    ;
+  for (; p < end; p++) {
+    switch (*p) {
+    case '\\':
+      g_string_append(rc, "\\\\");
+      break;
+    case '\n':
+      g_string_append(rc, "\\n");
+      break;
+    case '\t':
+      g_string_append(rc, "\\t");
+      break;
+    case '\r':
+      g_string_append(rc, "\\r");
+      break;
+    default:
+      g_string_append_c(rc, *p);
+    }
+  }
+  for (; *p; p++)
+    g_string_append(rc, "\\ ");
+  g_string_append_c(rc, '\n');
+}
+
+static void RcIntEntry(GString *rc, const gchar *key, gint value) {
+  g_string_append_printf(rc, "%s=%d\n", key, value);
+}
+
+static gchar *SerializeConfig(struct param_t *poConf)
+/* The rc file for the parameters, every field of param_t */
+{
+  struct alarm_t *alarm;
+  GString *rc = g_string_sized_new(512);
+  GPtrArray *alarms;
+  char key[32];
+  char time[6];
+  guint i;
+
+  RcEntry(rc, "TitleFont", poConf->titleFont);
+  RcEntry(rc, "DateFont", poConf->dateFont);
+  RcEntry(rc, "TimeFont", poConf->timeFont);
+  RcEntry(rc, "Title", poConf->title);
+  RcEntry(rc, "Timezone", poConf->timezone);
+  RcEntry(rc, "DateFormat", poConf->dateFormat);
+  RcEntry(rc, "TimeFormat", poConf->timeFormat);
+  RcEntry(rc, "Theme", poConf->theme);
+  RcEntry(rc, "Zones", poConf->zones);
+  RcIntEntry(rc, "ShowTitle", poConf->showTitle);
+  RcIntEntry(rc, "ShowDate", poConf->showDate);
+  RcIntEntry(rc, "ShowTime", poConf->showTime);
+  RcIntEntry(rc, "Mode", poConf->mode);
+  RcIntEntry(rc, "Countdown", poConf->countdown);
+
+  /* In a stable order, or the hash would change after every fire */
+  alarms = SortAlarms(poConf->alarms);
+  RcIntEntry(rc, "Alarms", alarms->len);
+  for (i = 0; i < alarms->len; i++) {
+    alarm = ALARM_AT(alarms, i);
+    g_snprintf(time, sizeof(time), "%02u:%02u", alarm->hr, alarm->min);
+    g_snprintf(key, sizeof(key), "AlarmTime%u", i);
+    RcEntry(rc, key, time);
+    g_snprintf(key, sizeof(key), "AlarmDays%u", i);
+    RcIntEntry(rc, key, alarm->days);
+    g_snprintf(key, sizeof(key), "AlarmText%u", i);
+    RcEntry(rc, key, alarm->text);
+  }
+  g_ptr_array_free(alarms, TRUE);
+
+  return g_string_free(rc, FALSE);
+}
+
+static gchar *HashConfig(const gchar *rc) {
+  return g_compute_checksum_for_string(G_CHECKSUM_SHA256, rc, -1);
+}
+
 static void clock_read_config(XfcePanelPlugin *plugin, analog_clock_t *poPlugin)
 /* Plugin API */
 /* Executed when the panel is started - Read the configuration
@@ -542,9 +1760,15 @@ static void clock_read_config(XfcePanelPlugin *plugin, analog_clock_t *poPlugin)
 {
   struct param_t *poConf = &(poPlugin->oConf.oParam);
   struct monitor_t *poMonitor = &(poPlugin->oMonitor);
+  struct alarm_t *alarm;
   const char *pc;
   char *file;
+  gchar *serialized;
+  char key[32];
+  guint hr, min;
+  gint i, n;
   XfceRc *rc;
+  CLOCK_TRACE_BEGIN(rc_read);
 
   if (!(file = xfce_panel_plugin_lookup_rc_file(plugin)))
     return;
@@ -580,41 +1804,96 @@ static void clock_read_config(XfcePanelPlugin *plugin, analog_clock_t *poPlugin)
     poConf->timezone = g_strdup(pc);
   }
 
+  if ((pc = xfce_rc_read_entry(rc, "Theme", NULL))) {
+    g_free(poConf->theme);
+    poConf->theme = g_strdup(pc);
+  }
+
+  if ((pc = xfce_rc_read_entry(rc, "DateFormat", NULL))) {
+    g_free(poConf->dateFormat);
+    poConf->dateFormat = g_strdup(pc);
+  }
+
+  if ((pc = xfce_rc_read_entry(rc, "TimeFormat", NULL))) {
+    g_free(poConf->timeFormat);
+    poConf->timeFormat = g_strdup(pc);
+  }
+
+  if ((pc = xfce_rc_read_entry(rc, "Zones", NULL))) {
+    g_free(poConf->zones);
+    poConf->zones = g_strdup(pc);
+  }
+
   poConf->showTitle =
       xfce_rc_read_int_entry(rc, "ShowTitle", poConf->showTitle);
   poConf->showDate = xfce_rc_read_int_entry(rc, "ShowDate", poConf->showDate);
   poConf->showTime = xfce_rc_read_int_entry(rc, "ShowTime", poConf->showTime);
+  poConf->mode = CLAMP(xfce_rc_read_int_entry(rc, "Mode", poConf->mode),
+                       CLOCK_MODE_CLOCK, CLOCK_MODE_COUNTDOWN);
+  poConf->countdown =
+      xfce_rc_read_int_entry(rc, "Countdown", poConf->countdown);
+
+  /* Alarms are scheduled once the timezone is known, see SetTimezone() */
+  n = xfce_rc_read_int_entry(rc, "Alarms", 0);
+  for (i = 0; i < n; i++) {
+    g_snprintf(key, sizeof(key), "AlarmTime%d", i);
+    if (!(pc = xfce_rc_read_entry(rc, key, NULL)) ||
+        sscanf(pc, "%u:%u", &hr, &min) != 2 || hr > 23 || min > 59)
+      continue;
+
+    alarm = g_new0(alarm_t, 1);
+    alarm->hr = hr;
+    alarm->min = min;
+    g_snprintf(key, sizeof(key), "AlarmDays%d", i);
+    alarm->days = xfce_rc_read_int_entry(rc, key, 0) & 0x7f;
+    g_snprintf(key, sizeof(key), "AlarmText%d", i);
+    alarm->text = g_strdup(xfce_rc_read_entry(rc, key, _("Alarm")));
+    g_ptr_array_add(poConf->alarms, alarm);
+  }
 
   xfce_rc_close(rc);
+
+  /* What is on disk now, saving it again can be skipped */
+  serialized = SerializeConfig(poConf);
+  poPlugin->rcHash = HashConfig(serialized);
+  g_free(serialized);
+  CLOCK_TRACE_END(rc_read);
 }
 
 static void clock_write_config(XfcePanelPlugin *plugin,
-                               analog_clock_t *poPlugin) {
+                               analog_clock_t *poPlugin)
+/* Writes the rc file, unless it already holds the current parameters.  The
+   new file replaces the old one atomically, readers never see half of it */
+{
   struct param_t *poConf = &(poPlugin->oConf.oParam);
-  XfceRc *rc;
+  GError *error = NULL;
+  gchar *rc, *hash;
   char *file;
-
-  if (!(file = xfce_panel_plugin_save_location(plugin, TRUE)))
-    return;
-
-  rc = xfce_rc_simple_open(file, FALSE);
-  g_free(file);
-
-  if (!rc)
-    return;
+  CLOCK_TRACE_BEGIN(rc_write);
 
   TRACE("clock_write_config()\n");
 
-  xfce_rc_write_entry(rc, "TitleFont", poConf->titleFont);
-  xfce_rc_write_entry(rc, "DateFont", poConf->dateFont);
-  xfce_rc_write_entry(rc, "TimeFont", poConf->timeFont);
-  xfce_rc_write_entry(rc, "Title", poConf->title);
-  xfce_rc_write_entry(rc, "Timezone", poConf->timezone);
-  xfce_rc_write_int_entry(rc, "ShowTitle", poConf->showTitle);
-  xfce_rc_write_int_entry(rc, "ShowDate", poConf->showDate);
-  xfce_rc_write_int_entry(rc, "ShowTime", poConf->showTime);
+  rc = SerializeConfig(poConf);
+  hash = HashConfig(rc);
+
+  if (g_strcmp0(hash, poPlugin->rcHash) == 0) {
+    poPlugin->oStats.rcSkips++;
+  } else if ((file = xfce_panel_plugin_save_location(plugin, TRUE))) {
+    if (g_file_set_contents(file, rc, -1, &error)) {
+      g_free(poPlugin->rcHash);
+      poPlugin->rcHash = hash;
+      hash = NULL;
+      poPlugin->oStats.rcWrites++;
+    } else {
+      g_warning("Cannot save the clock configuration: %s", error->message);
+      g_error_free(error);
+    }
+    g_free(file);
+  }
 
-  xfce_rc_close(rc);
+  g_free(hash);
+  g_free(rc);
+  CLOCK_TRACE_END(rc_write);
 }
 
 static void UpdateConf(void *p_pvPlugin)
@@ -626,17 +1905,17 @@ static void UpdateConf(void *p_pvPlugin)
 
   TRACE("UpdateConf()\n");
   SetMonitorFont(poPlugin);
-  /* Restart timer */
-  if (poPlugin->iTimerId) {
-    g_source_remove(poPlugin->iTimerId);
-    poPlugin->iTimerId = 0;
-  }
-  SetTimer(p_pvPlugin);
   SetTitle(p_pvPlugin);
+  SetTheme(poPlugin);
+  SetMode(poPlugin);
+  /* Reschedules the alarms and restarts the timer */
   SetTimezone(p_pvPlugin);
+  SetZones(poPlugin);
   SetVisibilityTitle(p_pvPlugin);
   SetVisibilityDate(p_pvPlugin);
   SetVisibilityTime(p_pvPlugin);
+  /* Fonts and visible lines decide the face size on a deskbar row */
+  UpdateSize(poPlugin);
 }
 
 static void About(XfcePanelPlugin *plugin) {
@@ -724,6 +2003,42 @@ static void ToggleShowTime(GtkWidget *button, void *data) {
   poConf->showTime = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(button));
 }
 
+static void UpdateMode(GtkWidget *combo, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+
+  poConf->mode = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+  gtk_widget_set_sensitive(poGUI->wCountdown,
+                           poConf->mode == CLOCK_MODE_COUNTDOWN);
+}
+
+static void UpdateCountdown(GtkWidget *spin, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  poConf->countdown = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(spin));
+}
+
+static void UpdateTheme(GtkWidget *chooser, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  gchar *dir = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+
+  g_free(poConf->theme);
+  poConf->theme = dir ? dir : g_strdup("");
+}
+
+static void ResetTheme(GtkWidget *button, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+
+  g_free(poConf->theme);
+  poConf->theme = g_strdup("");
+  gtk_file_chooser_unselect_all(GTK_FILE_CHOOSER(poGUI->wTheme));
+}
+
 static void UpdateTitle(GtkWidget *entry, void *data) {
   struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
   struct param_t *poConf = &(poPlugin->oConf.oParam);
@@ -741,27 +2056,297 @@ static void UpdateTimezone(GtkWidget *entry, void *data) {
   struct monitor_t *poMonitor = &(poPlugin->oMonitor);
 
   g_free(poConf->timezone);
-  if (poPlugin->tz)
-    g_time_zone_unref(poPlugin->tz);
 
+  /* Parsed once the dialog closes, see UpdateConf(), not every keystroke */
   poConf->timezone = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
-  SetTimezone(poPlugin);
+}
+
+static void UpdateZones(GtkWidget *entry, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+
+  g_free(poConf->zones);
+
+  /* Parsed once the dialog closes, see UpdateConf() */
+  poConf->zones = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+}
+
+static gchar *AlarmDaysToString(guint days)
+/* "Mon Wed Fri", or "" for a one-shot alarm */
+{
+  GString *str = g_string_new(NULL);
+  guint day;
+
+  for (day = 1; day <= 7; day++) {
+    if (!(days & (1 << (day - 1))))
+      continue;
+    if (str->len)
+      g_string_append_c(str, ' ');
+    g_string_append(str, GetWeekdayAsString(day));
+  }
+
+  return g_string_free(str, FALSE);
+}
+
+static guint AlarmDaysFromString(const gchar *text)
+/* Inverse of AlarmDaysToString(), unknown words are ignored */
+{
+  gchar **words = g_strsplit_set(text, " ,", -1);
+  guint days = 0, day, i;
+
+  for (i = 0; words[i]; i++)
+    for (day = 1; day <= 7; day++)
+      if (g_ascii_strcasecmp(words[i], GetWeekdayAsString(day)) == 0)
+        days |= 1 << (day - 1);
+  g_strfreev(words);
+
+  return days;
+}
+
+static void AppendAlarmRow(struct gui_t *poGUI, guint hr, guint min,
+                           guint days, const gchar *text) {
+  gchar time[8];
+  gchar *dayNames = AlarmDaysToString(days);
+
+  g_snprintf(time, sizeof(time), "%02u:%02u", hr, min);
+  gtk_list_store_insert_with_values(poGUI->alarmStore, NULL, -1,
+                                    ALARM_COLUMN_TIME, time,
+                                    ALARM_COLUMN_DAYS, dayNames,
+                                    ALARM_COLUMN_TEXT, text, -1);
+  g_free(dayNames);
+}
+
+static void SyncAlarmRows(struct analog_clock_t *poPlugin)
+/* Reload the dialog's alarm list from the alarms */
+{
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  struct alarm_t *alarm;
+  GPtrArray *alarms;
+  guint i;
+
+  gtk_list_store_clear(poGUI->alarmStore);
+  alarms = SortAlarms(poPlugin->oConf.oParam.alarms);
+  for (i = 0; i < alarms->len; i++) {
+    alarm = ALARM_AT(alarms, i);
+    AppendAlarmRow(poGUI, alarm->hr, alarm->min, alarm->days, alarm->text);
+  }
+  g_ptr_array_free(alarms, TRUE);
+}
+
+static void StoreAlarms(struct analog_clock_t *poPlugin)
+/* Replace the alarms with the rows of the dialog's list and re-arm */
+{
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  GtkTreeModel *model = GTK_TREE_MODEL(poPlugin->oConf.oGUI.alarmStore);
+  struct alarm_t *alarm;
+  GtkTreeIter iter;
+  gchar *time, *days, *text;
+  gboolean valid;
+  guint i;
+
+  for (i = 0; i < poConf->alarms->len; i++)
+    AlarmFree(ALARM_AT(poConf->alarms, i));
+  g_ptr_array_set_size(poConf->alarms, 0);
+
+  for (valid = gtk_tree_model_get_iter_first(model, &iter); valid;
+       valid = gtk_tree_model_iter_next(model, &iter)) {
+    gtk_tree_model_get(model, &iter, ALARM_COLUMN_TIME, &time,
+                       ALARM_COLUMN_DAYS, &days, ALARM_COLUMN_TEXT, &text, -1);
+    alarm = g_new0(alarm_t, 1);
+    sscanf(time, "%u:%u", &alarm->hr, &alarm->min);
+    alarm->days = AlarmDaysFromString(days);
+    alarm->text = text;
+    g_ptr_array_add(poConf->alarms, alarm);
+    g_free(time);
+    g_free(days);
+  }
+
+  RescheduleAlarms(poPlugin);
+  SetTimer(poPlugin);
+}
+
+static void EditAlarm(GtkCellRendererText *cell, gchar *path, gchar *text,
+                      void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  GtkTreeIter iter;
+  guint hr, min;
+  gchar time[8];
+  gchar *dayNames;
+
+  if (!gtk_tree_model_get_iter_from_string(GTK_TREE_MODEL(poGUI->alarmStore),
+                                           &iter, path))
+    return;
+
+  if (cell == GTK_CELL_RENDERER_TEXT(poGUI->rAlarmTime)) {
+    /* Keep the old time rather than storing something unparsable */
+    if (sscanf(text, "%u:%u", &hr, &min) != 2 || hr > 23 || min > 59)
+      return;
+    g_snprintf(time, sizeof(time), "%02u:%02u", hr, min);
+    gtk_list_store_set(poGUI->alarmStore, &iter, ALARM_COLUMN_TIME, time, -1);
+  } else if (cell == GTK_CELL_RENDERER_TEXT(poGUI->rAlarmDays)) {
+    dayNames = AlarmDaysToString(AlarmDaysFromString(text));
+    gtk_list_store_set(poGUI->alarmStore, &iter, ALARM_COLUMN_DAYS, dayNames,
+                       -1);
+    g_free(dayNames);
+  } else {
+    gtk_list_store_set(poGUI->alarmStore, &iter, ALARM_COLUMN_TEXT, text, -1);
+  }
+
+  StoreAlarms(poPlugin);
+}
+
+static void AddAlarm(GtkWidget *button, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+
+  AppendAlarmRow(&(poPlugin->oConf.oGUI), 7, 0, 0, _("Alarm"));
+  StoreAlarms(poPlugin);
+}
+
+static void RemoveAlarm(GtkWidget *button, void *data) {
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  GtkTreeSelection *selection;
+  GtkTreeIter iter;
+
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(poGUI->wAlarms));
+  if (!gtk_tree_selection_get_selected(selection, NULL, &iter))
+    return;
+
+  gtk_list_store_remove(poGUI->alarmStore, &iter);
+  StoreAlarms(poPlugin);
 }
 
 static void clock_dialog_response(GtkWidget *dlg, int response,
                                   analog_clock_t *clock) {
   UpdateConf(clock);
-  gtk_widget_destroy(dlg);
+  /* Keep the dialog around, the next open only has to re-sync it */
+  gtk_widget_hide(dlg);
   xfce_panel_plugin_unblock_menu(clock->plugin);
   clock_write_config(clock->plugin, clock);
   DisplayClock(clock);
 }
 
+static gboolean FillTimezones(void *data)
+/* Idle callback: walks the zoneinfo tree a few entries at a time and feeds
+   the timezone completion so the dialog never blocks the main loop */
+{
+  struct analog_clock_t *poPlugin = (struct analog_clock_t *)data;
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+  const gchar *name;
+  gchar *path, *zone;
+  gint i;
+
+  for (i = 0; i < TZ_BATCH; i++) {
+    if (poGUI->tzDir == NULL) {
+      g_free(poGUI->tzPath);
+      poGUI->tzPath = g_queue_pop_head(poGUI->tzDirs);
+      if (poGUI->tzPath == NULL) {
+        poGUI->iTzIdleId = 0;
+        return FALSE;
+      }
+      path = g_build_filename(TZ_DIR, poGUI->tzPath, NULL);
+      poGUI->tzDir = g_dir_open(path, 0, NULL);
+      g_free(path);
+      continue;
+    }
+
+    name = g_dir_read_name(poGUI->tzDir);
+    if (name == NULL) {
+      g_dir_close(poGUI->tzDir);
+      poGUI->tzDir = NULL;
+      continue;
+    }
+
+    /* Zone names are capitalised, this skips posix/, right/, *.tab, ... */
+    if (!g_ascii_isupper(name[0]) || strchr(name, '.'))
+      continue;
+
+    zone = (*poGUI->tzPath) ? g_build_filename(poGUI->tzPath, name, NULL)
+                            : g_strdup(name);
+    path = g_build_filename(TZ_DIR, zone, NULL);
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+      g_queue_push_tail(poGUI->tzDirs, zone);
+    } else {
+      gtk_list_store_insert_with_values(poGUI->tzStore, NULL, -1, 0, zone, -1);
+      g_free(zone);
+    }
+    g_free(path);
+  }
+
+  return TRUE;
+}
+
+static void StopFillTimezones(struct gui_t *poGUI) {
+  if (poGUI->iTzIdleId) {
+    g_source_remove(poGUI->iTzIdleId);
+    poGUI->iTzIdleId = 0;
+  }
+  if (poGUI->tzDir) {
+    g_dir_close(poGUI->tzDir);
+    poGUI->tzDir = NULL;
+  }
+  if (poGUI->tzDirs) {
+    g_queue_free_full(poGUI->tzDirs, g_free);
+    poGUI->tzDirs = NULL;
+  }
+  g_free(poGUI->tzPath);
+  poGUI->tzPath = NULL;
+}
+
+static void clock_sync_options(analog_clock_t *poPlugin)
+/* Reload the widgets of the (possibly hidden) dialog from the parameters */
+{
+  struct param_t *poConf = &(poPlugin->oConf.oParam);
+  struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
+
+  g_signal_handlers_block_by_func(poGUI->wTitle, UpdateTitle, poPlugin);
+  g_signal_handlers_block_by_func(poGUI->wTimezone, UpdateTimezone, poPlugin);
+  g_signal_handlers_block_by_func(poGUI->wZones, UpdateZones, poPlugin);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wShowTitle),
+                               poConf->showTitle);
+  gtk_entry_set_text(GTK_ENTRY(poGUI->wTitle), poConf->title);
+  gtk_button_set_label(GTK_BUTTON(poGUI->wTitleFont), poConf->titleFont);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wShowDate),
+                               poConf->showDate);
+  gtk_entry_set_text(GTK_ENTRY(poGUI->wDateFormat), poConf->dateFormat);
+  gtk_button_set_label(GTK_BUTTON(poGUI->wDateFont), poConf->dateFont);
+
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(poGUI->wShowTime),
+                               poConf->showTime);
+  gtk_entry_set_text(GTK_ENTRY(poGUI->wTimeFormat), poConf->timeFormat);
+  gtk_button_set_label(GTK_BUTTON(poGUI->wTimeFont), poConf->timeFont);
+
+  gtk_entry_set_text(GTK_ENTRY(poGUI->wTimezone), poConf->timezone);
+  gtk_entry_set_text(GTK_ENTRY(poGUI->wZones), poConf->zones);
+
+  gtk_combo_box_set_active(GTK_COMBO_BOX(poGUI->wMode), poConf->mode);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(poGUI->wCountdown),
+                            poConf->countdown);
+  gtk_widget_set_sensitive(poGUI->wCountdown,
+                           poConf->mode == CLOCK_MODE_COUNTDOWN);
+
+  if (*poConf->theme)
+    gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(poGUI->wTheme),
+                                  poConf->theme);
+  else
+    gtk_file_chooser_unselect_all(GTK_FILE_CHOOSER(poGUI->wTheme));
+
+  SyncAlarmRows(poPlugin);
+
+  g_signal_handlers_unblock_by_func(poGUI->wZones, UpdateZones, poPlugin);
+  g_signal_handlers_unblock_by_func(poGUI->wTimezone, UpdateTimezone, poPlugin);
+  g_signal_handlers_unblock_by_func(poGUI->wTitle, UpdateTitle, poPlugin);
+}
+
 static int clock_create_config_gui(GtkWidget *, struct param_t *,
                                    struct gui_t *);
 static void clock_create_options(XfcePanelPlugin *plugin,
                                  analog_clock_t *poPlugin) {
   GtkWidget *dlg, *vbox;
+  GtkEntryCompletion *completion;
   struct param_t *poConf = &(poPlugin->oConf.oParam);
   struct gui_t *poGUI = &(poPlugin->oConf.oGUI);
 
@@ -769,6 +2354,13 @@ static void clock_create_options(XfcePanelPlugin *plugin,
 
   xfce_panel_plugin_block_menu(plugin);
 
+  /* The dialog is built on first use and only hidden when closed */
+  if (poPlugin->oConf.wTopLevel) {
+    clock_sync_options(poPlugin);
+    gtk_window_present(GTK_WINDOW(poPlugin->oConf.wTopLevel));
+    return;
+  }
+
   dlg = xfce_titled_dialog_new_with_buttons(
       _("Analog Clock Configuration"),
       GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(plugin))),
@@ -776,6 +2368,8 @@ static void clock_create_options(XfcePanelPlugin *plugin,
 
   g_signal_connect(dlg, "response", G_CALLBACK(clock_dialog_response),
                    poPlugin);
+  g_signal_connect(dlg, "destroy", G_CALLBACK(gtk_widget_destroyed),
+                   &(poPlugin->oConf.wTopLevel));
 
   vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, BORDER + 6);
   gtk_container_set_border_width(GTK_CONTAINER(vbox), BORDER + 4);
@@ -787,7 +2381,6 @@ static void clock_create_options(XfcePanelPlugin *plugin,
 
   (void)clock_create_config_gui(GTK_WIDGET(vbox), poConf, poGUI);
 
-  gtk_button_set_label(GTK_BUTTON(poGUI->wTitleFont), poConf->titleFont);
   g_signal_connect(G_OBJECT(poGUI->wTitleFont), "clicked",
                    G_CALLBACK(ChooseTitleFont), poPlugin);
   g_signal_connect(G_OBJECT(poGUI->wTitle), "changed", G_CALLBACK(UpdateTitle),
@@ -795,13 +2388,11 @@ static void clock_create_options(XfcePanelPlugin *plugin,
   g_signal_connect(G_OBJECT(poGUI->wShowTitle), "toggled",
                    G_CALLBACK(ToggleShowTitle), poPlugin);
 
-  gtk_button_set_label(GTK_BUTTON(poGUI->wDateFont), poConf->dateFont);
   g_signal_connect(G_OBJECT(poGUI->wDateFont), "clicked",
                    G_CALLBACK(ChooseDateFont), poPlugin);
   g_signal_connect(G_OBJECT(poGUI->wShowDate), "toggled",
                    G_CALLBACK(ToggleShowDate), poPlugin);
 
-  gtk_button_set_label(GTK_BUTTON(poGUI->wTimeFont), poConf->timeFont);
   g_signal_connect(G_OBJECT(poGUI->wTimeFont), "clicked",
                    G_CALLBACK(ChooseTimeFont), poPlugin);
   g_signal_connect(G_OBJECT(poGUI->wShowTime), "toggled",
@@ -809,6 +2400,45 @@ static void clock_create_options(XfcePanelPlugin *plugin,
 
   g_signal_connect(G_OBJECT(poGUI->wTimezone), "changed",
                    G_CALLBACK(UpdateTimezone), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->wZones), "changed", G_CALLBACK(UpdateZones),
+                   poPlugin);
+
+  g_signal_connect(G_OBJECT(poGUI->wMode), "changed", G_CALLBACK(UpdateMode),
+                   poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->wCountdown), "value-changed",
+                   G_CALLBACK(UpdateCountdown), poPlugin);
+
+  g_signal_connect(G_OBJECT(poGUI->wTheme), "file-set",
+                   G_CALLBACK(UpdateTheme), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->wThemeReset), "clicked",
+                   G_CALLBACK(ResetTheme), poPlugin);
+
+  g_signal_connect(G_OBJECT(poGUI->rAlarmTime), "edited",
+                   G_CALLBACK(EditAlarm), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->rAlarmDays), "edited",
+                   G_CALLBACK(EditAlarm), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->rAlarmText), "edited",
+                   G_CALLBACK(EditAlarm), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->wAlarmAdd), "clicked",
+                   G_CALLBACK(AddAlarm), poPlugin);
+  g_signal_connect(G_OBJECT(poGUI->wAlarmRemove), "clicked",
+                   G_CALLBACK(RemoveAlarm), poPlugin);
+
+  clock_sync_options(poPlugin);
+
+  /* Timezone completion, populated in the background */
+  if (poGUI->tzStore == NULL) {
+    poGUI->tzStore = gtk_list_store_new(1, G_TYPE_STRING);
+    poGUI->tzDirs = g_queue_new();
+    g_queue_push_tail(poGUI->tzDirs, g_strdup(""));
+    poGUI->iTzIdleId = g_idle_add_full(G_PRIORITY_LOW, FillTimezones,
+                                       poPlugin, NULL);
+  }
+  completion = gtk_entry_completion_new();
+  gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(poGUI->tzStore));
+  gtk_entry_completion_set_text_column(completion, 0);
+  gtk_entry_set_completion(GTK_ENTRY(poGUI->wTimezone), completion);
+  g_object_unref(completion);
 
   gtk_widget_show(dlg);
 }
@@ -825,22 +2455,46 @@ static gboolean clock_remote_event(XfcePanelPlugin *plugin, const gchar *name,
     return TRUE;
   }
 
+  if (strcmp(name, "stats") == 0) {
+    if (value != NULL && G_VALUE_HOLDS_BOOLEAN(value) &&
+        g_value_get_boolean(value)) {
+      /* dump the performance counters to the panel log */
+      StatsDump(clock);
+    }
+    return TRUE;
+  }
+
+  if (strcmp(name, "reset-stats") == 0) {
+    if (value != NULL && G_VALUE_HOLDS_BOOLEAN(value) &&
+        g_value_get_boolean(value)) {
+      StatsReset(&(clock->oStats));
+    }
+    return TRUE;
+  }
+
   return FALSE;
 }
 
 static gboolean size_cb(XfcePanelPlugin *plugin, guint size, void *base) {
-  gint frame_h, frame_v, history;
   struct analog_clock_t *clock = (struct analog_clock_t *)base;
   struct monitor_t *poMonitor = &(clock->oMonitor);
 
-  frame_h = size - BORDER;
-  frame_v = size - BORDER;
-
-  gtk_widget_set_size_request(GTK_WIDGET(poMonitor->wClock), frame_h, frame_v);
+  if (size != poMonitor->size) {
+    poMonitor->size = size;
+    UpdateSize(clock);
+  }
 
   return TRUE;
 }
 
+static void mode_cb(XfcePanelPlugin *plugin, XfcePanelPluginMode mode,
+                    void *base) {
+  struct analog_clock_t *clock = (struct analog_clock_t *)base;
+
+  SetLayout(clock, mode);
+  UpdateSize(clock);
+}
+
 static int clock_create_config_gui(GtkWidget *vbox, struct param_t *poConf,
                                    struct gui_t *gui) {
   GtkWidget *table1;
@@ -863,6 +2517,31 @@ static int clock_create_config_gui(GtkWidget *vbox, struct param_t *poConf,
   GtkWidget *wLabelTZ;
   GtkWidget *wTimezone;
 
+  GtkWidget *hboxZones;
+  GtkWidget *wLabelZones;
+  GtkWidget *wZones;
+
+  GtkWidget *hboxMode;
+  GtkWidget *wMode;
+  GtkWidget *wCountdown;
+
+  GtkWidget *hboxTheme;
+  GtkWidget *wLabelTheme;
+  GtkWidget *wTheme;
+  GtkWidget *wThemeReset;
+
+  GtkWidget *vboxAlarms;
+  GtkWidget *wLabelAlarms;
+  GtkWidget *wAlarmScroll;
+  GtkWidget *wAlarms;
+  GtkWidget *hboxAlarmButtons;
+  GtkWidget *wAlarmAdd;
+  GtkWidget *wAlarmRemove;
+  GtkListStore *alarmStore;
+  GtkCellRenderer *rAlarmTime;
+  GtkCellRenderer *rAlarmDays;
+  GtkCellRenderer *rAlarmText;
+
   table1 = gtk_grid_new();
   gtk_grid_set_column_spacing(GTK_GRID(table1), 2);
   gtk_grid_set_row_spacing(GTK_GRID(table1), 2);
@@ -896,6 +2575,64 @@ static int clock_create_config_gui(GtkWidget *vbox, struct param_t *poConf,
 
   gtk_box_pack_start(GTK_BOX(vbox), hboxTZ, TRUE, TRUE, 0);
 
+  /* Extra time zones shown in the tooltip */
+  hboxZones = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+  gtk_widget_show(hboxZones);
+
+  wLabelZones = gtk_label_new(_("Tooltip timezones"));
+  gtk_widget_show(wLabelZones);
+  gtk_box_pack_start(GTK_BOX(hboxZones), wLabelZones, TRUE, TRUE, 0);
+
+  wZones = gtk_entry_new();
+  gtk_entry_set_text(GTK_ENTRY(wZones), poConf->zones);
+  gtk_entry_set_placeholder_text(GTK_ENTRY(wZones),
+                                 "Europe/London, America/New_York");
+  gtk_widget_set_tooltip_text(wZones, _("Comma separated timezone names"));
+  gtk_widget_show(wZones);
+  gtk_box_pack_start(GTK_BOX(hboxZones), wZones, TRUE, TRUE, 0);
+
+  gtk_box_pack_start(GTK_BOX(vbox), hboxZones, TRUE, TRUE, 0);
+
+  /* Mode: clock, stopwatch or countdown (minutes) */
+  hboxMode = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+  gtk_widget_show(hboxMode);
+
+  wMode = gtk_combo_box_text_new();
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wMode), _("Clock"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wMode), _("Stopwatch"));
+  gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(wMode), _("Countdown"));
+  gtk_combo_box_set_active(GTK_COMBO_BOX(wMode), poConf->mode);
+  gtk_widget_show(wMode);
+  gtk_box_pack_start(GTK_BOX(hboxMode), wMode, TRUE, TRUE, 0);
+
+  wCountdown = gtk_spin_button_new_with_range(1, 24 * 60, 1);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(wCountdown), poConf->countdown);
+  gtk_widget_set_tooltip_text(wCountdown, _("Countdown length in minutes"));
+  gtk_widget_show(wCountdown);
+  gtk_box_pack_start(GTK_BOX(hboxMode), wCountdown, TRUE, TRUE, 0);
+
+  gtk_box_pack_start(GTK_BOX(vbox), hboxMode, TRUE, TRUE, 0);
+
+  /* Face theme: a directory with face.theme and its SVGs */
+  hboxTheme = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+  gtk_widget_show(hboxTheme);
+
+  wLabelTheme = gtk_label_new(_("Face theme"));
+  gtk_widget_show(wLabelTheme);
+  gtk_box_pack_start(GTK_BOX(hboxTheme), wLabelTheme, TRUE, TRUE, 0);
+
+  wTheme = gtk_file_chooser_button_new(_("Select a clock face theme"),
+                                       GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER);
+  gtk_widget_show(wTheme);
+  gtk_box_pack_start(GTK_BOX(hboxTheme), wTheme, TRUE, TRUE, 0);
+
+  wThemeReset = gtk_button_new_with_label(_("Built-in"));
+  gtk_widget_set_tooltip_text(wThemeReset, _("Use the built-in clock face"));
+  gtk_widget_show(wThemeReset);
+  gtk_box_pack_start(GTK_BOX(hboxTheme), wThemeReset, FALSE, FALSE, 0);
+
+  gtk_box_pack_start(GTK_BOX(vbox), hboxTheme, TRUE, TRUE, 0);
+
   /* Title */
   /* Show title check box */
   wShowTitle = gtk_check_button_new_with_mnemonic("Tit_le");
@@ -958,6 +2695,72 @@ static int clock_create_config_gui(GtkWidget *vbox, struct param_t *poConf,
 
   gtk_box_pack_start(GTK_BOX(vbox), grid, TRUE, TRUE, 0);
 
+  /* Alarms: time, weekdays (none fires once) and the notice text */
+  vboxAlarms = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+  gtk_widget_show(vboxAlarms);
+
+  wLabelAlarms = gtk_label_new(_("Alarms"));
+  gtk_widget_set_halign(wLabelAlarms, GTK_ALIGN_START);
+  gtk_widget_show(wLabelAlarms);
+  gtk_box_pack_start(GTK_BOX(vboxAlarms), wLabelAlarms, FALSE, FALSE, 0);
+
+  alarmStore = gtk_list_store_new(ALARM_N_COLUMNS, G_TYPE_STRING,
+                                  G_TYPE_STRING, G_TYPE_STRING);
+  wAlarms = gtk_tree_view_new_with_model(GTK_TREE_MODEL(alarmStore));
+  /* The view holds the only reference */
+  g_object_unref(alarmStore);
+
+  rAlarmTime = gtk_cell_renderer_text_new();
+  g_object_set(rAlarmTime, "editable", TRUE, NULL);
+  gtk_tree_view_insert_column_with_attributes(
+      GTK_TREE_VIEW(wAlarms), -1, _("Time"), rAlarmTime, "text",
+      ALARM_COLUMN_TIME, NULL);
+
+  rAlarmDays = gtk_cell_renderer_text_new();
+  g_object_set(rAlarmDays, "editable", TRUE, "placeholder-text", _("Once"),
+               NULL);
+  gtk_tree_view_insert_column_with_attributes(
+      GTK_TREE_VIEW(wAlarms), -1, _("Days"), rAlarmDays, "text",
+      ALARM_COLUMN_DAYS, NULL);
+
+  rAlarmText = gtk_cell_renderer_text_new();
+  g_object_set(rAlarmText, "editable", TRUE, NULL);
+  gtk_tree_view_insert_column_with_attributes(
+      GTK_TREE_VIEW(wAlarms), -1, _("Text"), rAlarmText, "text",
+      ALARM_COLUMN_TEXT, NULL);
+
+  gtk_widget_set_tooltip_text(
+      wAlarms, _("Days are weekday names, e.g. \"Mon Tue Wed Thu Fri\"; "
+                 "an alarm without days fires once"));
+  gtk_widget_show(wAlarms);
+
+  wAlarmScroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(wAlarmScroll),
+                                 GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(wAlarmScroll),
+                                      GTK_SHADOW_IN);
+  gtk_widget_set_size_request(wAlarmScroll, -1, 100);
+  gtk_container_add(GTK_CONTAINER(wAlarmScroll), wAlarms);
+  gtk_widget_show(wAlarmScroll);
+  gtk_box_pack_start(GTK_BOX(vboxAlarms), wAlarmScroll, TRUE, TRUE, 0);
+
+  hboxAlarmButtons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+  gtk_widget_show(hboxAlarmButtons);
+
+  wAlarmAdd = gtk_button_new_with_mnemonic(_("_Add"));
+  gtk_widget_show(wAlarmAdd);
+  gtk_box_pack_start(GTK_BOX(hboxAlarmButtons), wAlarmAdd, FALSE, FALSE, 0);
+
+  wAlarmRemove = gtk_button_new_with_mnemonic(_("_Remove"));
+  gtk_widget_set_tooltip_text(wAlarmRemove, _("Remove the selected alarm"));
+  gtk_widget_show(wAlarmRemove);
+  gtk_box_pack_start(GTK_BOX(hboxAlarmButtons), wAlarmRemove, FALSE, FALSE,
+                     0);
+
+  gtk_box_pack_start(GTK_BOX(vboxAlarms), hboxAlarmButtons, FALSE, FALSE, 0);
+
+  gtk_box_pack_start(GTK_BOX(vbox), vboxAlarms, TRUE, TRUE, 0);
+
   gui->wShowTitle = wShowTitle;
   gui->wTitle = wTitle;
   gui->wTitleFont = wTitleFont;
@@ -968,24 +2771,68 @@ static int clock_create_config_gui(GtkWidget *vbox, struct param_t *poConf,
   gui->wTimeFormat = wTimeFormat;
   gui->wTimeFont = wTimeFont;
   gui->wTimezone = wTimezone;
+  gui->wZones = wZones;
+  gui->wMode = wMode;
+  gui->wCountdown = wCountdown;
+  gui->wTheme = wTheme;
+  gui->wThemeReset = wThemeReset;
+  gui->wAlarms = wAlarms;
+  gui->wAlarmAdd = wAlarmAdd;
+  gui->wAlarmRemove = wAlarmRemove;
+  gui->alarmStore = alarmStore;
+  gui->rAlarmTime = rAlarmTime;
+  gui->rAlarmDays = rAlarmDays;
+  gui->rAlarmText = rAlarmText;
 
   return (0);
 }
 
+static gboolean clock_startup_idle(void *data)
+/* Second startup stage, run once the panel had a chance to paint: fonts,
+   the face theme, tooltip zones and the size metrics that depend on them */
+{
+  struct analog_clock_t *clock = (struct analog_clock_t *)data;
+  CLOCK_TRACE_BEGIN(startup_idle);
+
+  clock->iStartupId = 0;
+  SetMonitorFont(clock);
+  SetTheme(clock);
+  SetZones(clock);
+  UpdateSize(clock);
+  clock->oStats.ready = g_get_monotonic_time() - clock->started;
+
+  CLOCK_TRACE_END(startup_idle);
+  return FALSE;
+}
+
 static void clock_construct(XfcePanelPlugin *plugin) {
   analog_clock_t *clock;
+  gint64 started = g_get_monotonic_time();
+  CLOCK_TRACE_BEGIN(construct);
 
   clock = clock_create_control(plugin);
+  clock->started = started;
 
   clock_read_config(plugin, clock);
 
   gtk_container_add(GTK_CONTAINER(plugin), clock->oMonitor.wEventBox);
 
-  UpdateConf(clock);
+  /* First stage, only what the first frame shows: the built-in face with
+     the configured time and labels.  The rest of UpdateConf() follows at
+     idle, see clock_startup_idle() */
+  SetLayout(clock, xfce_panel_plugin_get_mode(plugin));
+  SetTitle(clock);
+  SetMode(clock);
+  SetTimezone(clock);
+  SetVisibilityTitle(clock);
+  SetVisibilityDate(clock);
+  SetVisibilityTime(clock);
+  clock->iStartupId = g_idle_add(clock_startup_idle, clock);
 
   g_signal_connect(plugin, "free-data", G_CALLBACK(clock_free), clock);
   g_signal_connect(plugin, "save", G_CALLBACK(clock_write_config), clock);
   g_signal_connect(plugin, "size-changed", G_CALLBACK(size_cb), clock);
+  g_signal_connect(plugin, "mode-changed", G_CALLBACK(mode_cb), clock);
 
   xfce_panel_plugin_menu_show_about(plugin);
   g_signal_connect(plugin, "about", G_CALLBACK(About), plugin);
@@ -996,6 +2843,9 @@ static void clock_construct(XfcePanelPlugin *plugin) {
 
   g_signal_connect(plugin, "remote-event", G_CALLBACK(clock_remote_event),
                    clock);
+
+  clock->oStats.construct = g_get_monotonic_time() - started;
+  CLOCK_TRACE_END(construct);
 }
 
 XFCE_PANEL_PLUGIN_REGISTER(clock_construct)